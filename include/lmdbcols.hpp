@@ -13,6 +13,39 @@
 #include <type_traits>
 #include <vector>
 #include <iostream>
+#include <cerrno>
+#include <cstring>
+#include <cstddef>
+#include <iterator>
+#include <utility>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <algorithm>
+#include <tuple>
+#include <exception>
+#include <future>
+#include <functional>
+#include <deque>
+#include <unordered_map>
+#include <fstream>
+#include <sstream>
+
+#if defined(__unix__) || defined(__APPLE__)
+#  include <sys/mman.h>
+#  include <unistd.h>
+#  define LMDBCOLS_HAVE_MADVISE 1
+#elif defined(_WIN32)
+#  include <process.h>
+#endif
+
+#ifdef __SSE2__
+#  include <emmintrin.h>
+#endif
 
 #include <lmdb++.h>
 
@@ -41,6 +74,23 @@ namespace lmdbcols {
     }  // namespace detail
 
 
+    // ======================================================================
+    // == MDB_val construction ===
+    // ==
+    // ==   LMDB takes non-const data pointers even where it only reads through
+    // ==   them, so we cast constness away in exactly one place.
+    // ======================================================================
+
+    namespace detail {
+        template <typename T>
+        inline MDB_val toMdbVal(const T *data, const size_t count) {
+            return MDB_val {sizeof(T) * count, const_cast<void*>(static_cast<const void*>(data))}; }
+
+        template <typename T>
+        inline MDB_val toMdbVal(const T &obj) { return toMdbVal(&obj, 1); }
+    }  // namespace detail
+
+
     // ======================================================================
     // == EightPadded ===
     // ==
@@ -100,6 +150,65 @@ namespace lmdbcols {
     static_assert(  is_valid_keyval_type<EightPadded<char>>::value, "" );
 
 
+    // ======================================================================
+    // == key_dbiflags ===
+    // ==
+    // ==   Compile time choice of the extra LMDB flags a key type's DB should
+    // ==   be created with.
+    // ==
+    // ==   Unsigned integers the size of a size_t (e.g. uint64_t IDs) get
+    // ==   MDB_INTEGERKEY, so LMDB compares them as native integers: cheaper
+    // ==   than memcmp, and gives proper numeric order for scans (memcmp order
+    // ==   on little-endian bytes isn't).
+    // ==   On little-endian machines the same goes for EightPadded smaller
+    // ==   unsigned ints, since the padding zero-extends them to a size_t.
+    // ==
+    // ==   Everything else gets 0, i.e. plain memcmp order.
+    // ==
+    // ==   The MapDB classes apply this when you don't give explicit dbiFlags.
+    // ==   NB DBs made before this existed are memcmp ordered; open those with
+    // ==   explicit dbiFlags (e.g. MDB_CREATE) to keep using them as they are.
+    // ======================================================================
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__ || defined(_WIN32)
+#  define LMDBCOLS_LITTLE_ENDIAN 1
+#endif
+
+    namespace detail {
+        template <class T>
+        struct is_native_integer_key {
+            static constexpr bool value = std::is_integral<T>::value && std::is_unsigned<T>::value
+                                          && sizeof(T) == sizeof(size_t);
+        };
+    }
+
+    template <class T>
+    struct key_dbiflags {
+        static constexpr unsigned int value =
+            detail::is_native_integer_key<T>::value ? MDB_INTEGERKEY : 0;
+    };
+
+#ifdef LMDBCOLS_LITTLE_ENDIAN
+    template <class T>
+    struct key_dbiflags<EightPadded<T>> {
+        static constexpr unsigned int value =
+            (std::is_integral<T>::value && std::is_unsigned<T>::value
+             && sizeof(EightPadded<T>) == sizeof(size_t)) ? MDB_INTEGERKEY : 0;
+    };
+#endif
+
+    static_assert( key_dbiflags<double>::value == 0, "" );
+    static_assert( key_dbiflags<int64_t>::value == 0, "" );
+    static_assert( sizeof(size_t) != 8 || key_dbiflags<uint64_t>::value == MDB_INTEGERKEY, "" );
+
+    // Same again for the values of DUPSORT DBs (see MapDB_Pod_MultiPod), which
+    // LMDB keeps sorted too: native integers get MDB_INTEGERDUP
+    template <class T>
+    struct dup_dbiflags {
+        static constexpr unsigned int value = key_dbiflags<T>::value ? MDB_INTEGERDUP : 0;
+    };
+
+
     // ======================================================================
     // == LmdbSpan ===
     // ==
@@ -180,297 +289,4600 @@ namespace lmdbcols {
     
 
     // ======================================================================
-    // == DatabaseEnvironment ===
-    // ==
-    // ==   Simplified wrapper around MDB_env / lmdb::env.
-    // ==   Assumes you want a bare db file, rather than a directory.
+    // == LmdbWriteSpan ===
     // ==
-    // ==   Makes reasonably sensible guesses about maxDBs and map size (which
-    // ==   you can override).
-    // ==   Also lets you open read/readwrite transactions easily.
+    // ==   Writable counterpart to LmdbSpan: space LMDB has set aside inside
+    // ==   the map for a value being put (see MDB_RESERVE), which you then fill
+    // ==   in directly rather than building the value elsewhere and copying it.
     // ==
-    // ==   NB we round the requested mapsize up to the next multiple of 4096,
-    // ==   as the DB requires it and most callers don't care.
+    // ==   Fill it in before doing anything else with the txn; the space only
+    // ==   stays put until the next write through it, and is gone at commit.
+    // ==   Contents start out undefined.
     // ======================================================================
-    
-    class DatabaseEnvironment {
-        static constexpr size_t defaultMaxSize = 1UL * 1024UL * 1024UL * 1024UL; // 1GB
-        static constexpr size_t defaultMaxDbs = 10;  // TODO consider this
 
-        lmdb::env m_env;
-    
+    template <typename T>
+    class LmdbWriteSpan {
+        T *m_data; size_t m_size;  // size is number of T's
+
     public:
-        explicit DatabaseEnvironment(const string &dbPath,
-                                     size_t maxSize = defaultMaxSize,
-                                     size_t maxDbs = defaultMaxDbs)
-                :m_env{lmdb::env::create()}
+        size_t size()  const {return m_size;}
+        T *    begin() const {return m_data;}
+        T *    end()   const {return m_data + m_size;}
+
+        explicit LmdbWriteSpan(T *ptr, size_t count) :m_data{ptr}, m_size{count} {}
+
+        explicit LmdbWriteSpan(MDB_val mv) :m_data{reinterpret_cast<T*>(mv.mv_data)},
+                                            m_size{mv.mv_size/sizeof(T)}
         {
-            m_env.set_mapsize((maxSize % 4096 == 0)
-                              ? maxSize
-                              : (maxSize + 4096 - (maxSize%4096)));
-            m_env.set_max_dbs(maxDbs);
-            m_env.open(dbPath.c_str(), MDB_NOSUBDIR, 0664);
+            assert( !(mv.mv_size % sizeof(T)) );
+            assert( !(reinterpret_cast<std::uintptr_t>(m_data) % alignof(T)) );
         }
 
-        lmdb::txn openWriteTxn() {return lmdb::txn::begin(m_env, nullptr); }
-        lmdb::txn openReadTxn()  {return lmdb::txn::begin(m_env, nullptr, MDB_RDONLY);}
+        T& operator[](size_t n) const {
+            assert(n < m_size);
+            return m_data[n];
+        }
+
+        LmdbSpan<T> asConst() const {return LmdbSpan<T>{m_data, m_size};}
     };
 
 
     // ======================================================================
-    // == DbiWrapper ===
+    // == PaddedSpan ===
     // ==
-    // ==   Wrapper around MDB_dbi / lmdb::dbi, with a bit more functionality
-    // ==   that we neeed, as explicitly as possible.
-    // ==   Clients are very unlikely to want to use this class.
+    // ==   View over an LmdbSpan<EightPadded<T>> that hands out the T's
+    // ==   themselves, so you don't have to strip the padding off each
+    // ==   element. Zero-copy, like the span it wraps.
     // ==
-    // ==   NB doesn't hande issues like alignment - just dumbly handles groups
-    // ==   of bytes.
+    // ==   Its iterators are random access, stepping sizeof(EightPadded<T>)
+    // ==   bytes at a time, so std algorithms work straight over it.
+    // ==
+    // ==   When you want the values as a dense T array (e.g. for a numeric
+    // ==   kernel to vectorise over), copyOut() is the fast way there: with
+    // ==   SSE2 it packs chars, 32-bit ints and floats 16 or 4 at a time.
     // ======================================================================
-    
-    class DbiWrapper {
-        static constexpr unsigned int default_dbiflags = (MDB_CREATE);
-        
-        const string m_dbName;
-        const unsigned int m_dbiflags = default_dbiflags;
-    
-        lmdb::dbi dbi(lmdb::txn &txn) {
-            // FIXME use manual mdb_dbi_open here, and throw exception
-            // if it returns MDB_NOTFOUND error code (for read txns in empty db)
-            return lmdb::dbi::open(txn, m_dbName.c_str(), m_dbiflags);
+
+    namespace detail {
+        template <typename T>
+        inline void copyOutPadded(const EightPadded<T> *src, size_t n, T *dest) {
+            for(size_t i = 0; i < n; ++i) dest[i] = *src[i];
         }
-    
-    public:
-        explicit DbiWrapper(const string &dbName, const unsigned int dbiflags=default_dbiflags)
-            :m_dbName{dbName}, m_dbiflags{dbiflags} {}
 
-        // --- Putting
-    
-        template <typename K, typename V>
-        void put(lmdb::txn &txn, const K &key, const V &val) {
-            // TODO idiomatic casts
-            MDB_val mkey {sizeof(key), (void*)(&key)};
-            MDB_val mval {sizeof(val), (void*)(&val)};
-            auto rc = mdb_put(txn, dbi(txn), &mkey, &mval, 0);
-            if(rc) lmdb::error::raise("DbiWrapper PUT error", rc);
+#ifdef __SSE2__
+        // One byte at the start of every eight: mask each 64-bit lane down
+        // to it, gather the lanes' low dwords and pack 16 of them down to bytes
+        inline void copyOutPaddedBytes(const unsigned char *src, size_t n, unsigned char *dest) {
+            const __m128i lowByte = _mm_set1_epi64x(0xFF);
+            auto load = [&](size_t elem) {  // -> [v, 0, v+1, 0] as dwords
+                return _mm_and_si128(lowByte, _mm_loadu_si128(
+                                         reinterpret_cast<const __m128i*>(src + elem * 8)));
+            };
+            auto lowDwords = [](__m128i a, __m128i b) {  // -> [a0, a2, b0, b2]
+                return _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(a), _mm_castsi128_ps(b),
+                                                       _MM_SHUFFLE(2,0,2,0)));
+            };
+
+            size_t i = 0;
+            for(; i + 16 <= n; i += 16) {
+                const __m128i d0 = lowDwords(load(i),      load(i + 2));
+                const __m128i d1 = lowDwords(load(i + 4),  load(i + 6));
+                const __m128i d2 = lowDwords(load(i + 8),  load(i + 10));
+                const __m128i d3 = lowDwords(load(i + 12), load(i + 14));
+                // Values are 0..255, so neither pack saturates
+                const __m128i w0 = _mm_packs_epi32(d0, d1);
+                const __m128i w1 = _mm_packs_epi32(d2, d3);
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + i), _mm_packus_epi16(w0, w1));
+            }
+            for(; i < n; ++i) dest[i] = src[i * 8];
         }
 
-        template <typename K, typename VElem>
-        void putArray(lmdb::txn &txn, const K &key, const VElem *dat, size_t count) {
-            // TODO idiomatic casts
-            MDB_val mkey {sizeof(key), (void*)&key};
-            MDB_val mval {sizeof(dat[0])*count, (void*)dat};
-            auto rc = mdb_put(txn, dbi(txn), &mkey, &mval, 0);
-            if(rc) lmdb::error::raise("DbiWraper PUT ARRAY error", rc);
+        // Four bytes at the start of every eight: keep dwords 0 and 2 of each load
+        inline void copyOutPaddedDwords(const unsigned char *src, size_t n, unsigned char *dest) {
+            size_t i = 0;
+            for(; i + 4 <= n; i += 4) {
+                const __m128 a = _mm_loadu_ps(reinterpret_cast<const float*>(src + i * 8));
+                const __m128 b = _mm_loadu_ps(reinterpret_cast<const float*>(src + i * 8 + 16));
+                _mm_storeu_ps(reinterpret_cast<float*>(dest + i * 4),
+                              _mm_shuffle_ps(a, b, _MM_SHUFFLE(2,0,2,0)));
+            }
+            for(; i < n; ++i) memcpy(dest + i * 4, src + i * 8, 4);
         }
 
-        // --- Getting
-    
-        template <typename K>
-        LmdbSpan<unsigned char> get(lmdb::txn &txn, const K &key) {
-            MDB_val mval;
-            // TODO idiomatic cast
-            MDB_val mkey {sizeof(key), (void*)&key};
-            int rc = mdb_get(txn, dbi(txn), &mkey, &mval);
-            if(rc) lmdb::error::raise("DbiWrapper GET error", rc);
-            return LmdbSpan<unsigned char>{mval};
+        inline void copyOutPadded(const EightPadded<char> *src, size_t n, char *dest) {
+            copyOutPaddedBytes(reinterpret_cast<const unsigned char *>(src), n,
+                               reinterpret_cast<unsigned char *>(dest)); }
+        inline void copyOutPadded(const EightPadded<signed char> *src, size_t n, signed char *dest) {
+            copyOutPaddedBytes(reinterpret_cast<const unsigned char *>(src), n,
+                               reinterpret_cast<unsigned char *>(dest)); }
+        inline void copyOutPadded(const EightPadded<unsigned char> *src, size_t n, unsigned char *dest) {
+            copyOutPaddedBytes(reinterpret_cast<const unsigned char *>(src), n, dest); }
+        inline void copyOutPadded(const EightPadded<int32_t> *src, size_t n, int32_t *dest) {
+            copyOutPaddedDwords(reinterpret_cast<const unsigned char *>(src), n,
+                                reinterpret_cast<unsigned char *>(dest)); }
+        inline void copyOutPadded(const EightPadded<uint32_t> *src, size_t n, uint32_t *dest) {
+            copyOutPaddedDwords(reinterpret_cast<const unsigned char *>(src), n,
+                                reinterpret_cast<unsigned char *>(dest)); }
+        inline void copyOutPadded(const EightPadded<float> *src, size_t n, float *dest) {
+            copyOutPaddedDwords(reinterpret_cast<const unsigned char *>(src), n,
+                                reinterpret_cast<unsigned char *>(dest)); }
+#endif
+    }  // namespace detail
+
+    template <typename T>
+    class PaddedSpan {
+        using Padded = EightPadded<T>;
+        const Padded *m_data; size_t m_size;
+
+    public:
+        class iterator {
+            const Padded *m_p;
+
+        public:
+            using iterator_category = std::random_access_iterator_tag;
+            using value_type        = T;
+            using difference_type   = std::ptrdiff_t;
+            using pointer           = const T*;
+            using reference         = const T&;
+
+            iterator() :m_p{nullptr} {}
+            explicit iterator(const Padded *p) :m_p{p} {}
+
+            reference operator*()  const {return m_p->cget();}
+            pointer   operator->() const {return &m_p->cget();}
+            reference operator[](difference_type n) const {return m_p[n].cget();}
+
+            iterator& operator++() {++m_p; return *this;}
+            iterator& operator--() {--m_p; return *this;}
+            iterator  operator++(int) {auto res = *this; ++m_p; return res;}
+            iterator  operator--(int) {auto res = *this; --m_p; return res;}
+
+            iterator& operator+=(difference_type n) {m_p += n; return *this;}
+            iterator& operator-=(difference_type n) {m_p -= n; return *this;}
+            iterator  operator+(difference_type n) const {return iterator{m_p + n};}
+            iterator  operator-(difference_type n) const {return iterator{m_p - n};}
+            friend iterator operator+(difference_type n, const iterator &it) {return it + n;}
+            difference_type operator-(const iterator &o) const {return m_p - o.m_p;}
+
+            bool operator==(const iterator &o) const {return m_p == o.m_p;}
+            bool operator!=(const iterator &o) const {return m_p != o.m_p;}
+            bool operator< (const iterator &o) const {return m_p <  o.m_p;}
+            bool operator> (const iterator &o) const {return m_p >  o.m_p;}
+            bool operator<=(const iterator &o) const {return m_p <= o.m_p;}
+            bool operator>=(const iterator &o) const {return m_p >= o.m_p;}
+        };
+        using const_iterator = iterator;
+        using value_type     = T;
+
+        explicit PaddedSpan(LmdbSpan<Padded> sp) :m_data{sp.begin()}, m_size{sp.size()} {}
+
+        size_t   size()   const {return m_size;}
+        bool     isNull() const {return m_data == nullptr;}
+        iterator begin()  const {return iterator{m_data};}
+        iterator end()    const {return iterator{m_data + m_size};}
+
+        const T& operator[](size_t n) const {
+            assert(n < m_size);
+            return m_data[n].cget();
         }
 
-        // --- Key presence checking
-        template <typename K>
-        bool exists(lmdb::txn &txn, const K &key) {
-            // TODO idiomatic cast
-            MDB_val mkey {sizeof(key), (void*)&key};
-            MDB_val mval;
-            int rc = mdb_get(txn, dbi(txn), &mkey, &mval);
-            auto myDbi = dbi(txn);
-            if(rc == MDB_NOTFOUND) return false;
-            else if(rc == 0)       return true;
-            else lmdb::error::raise("DbiWrapper EXISTS error", rc);
+        PaddedSpan<T> subSpan(size_t offset, size_t count) const {
+            assert( offset + count <= size() );
+            return PaddedSpan<T>{ LmdbSpan<Padded>{m_data + offset, count} };
         }
-    };
-    
-    
-    // ======================================================================
-    // == MapDB_PodPod ===
-    // ==
-    // ==   Manager for a single named LMDB database (within a db file) that
-    // ==   has all keys of the POD type TAllKey, and all values of type TAllVal.
-    // ==   (The 'All' bit refers to alignment; see below.)
-    // ==
-    // ==   Gives you simple get/put access to the contents.
-    // ==
-    // ==   You are required to provide TAllKey and TAllVal with sizeof % 8,
-    // ==   to preserve alignment inside the database.
-    // ==
-    // ==   See the EightPadded type if you want an easy way of making a suitable
-    // ==   type from yours, or MapDB_AutoPadded_Pod_Pod if you want the
-    // ==   EightPadded wrapping to be applied automatically.
-    // ======================================================================
 
-    template <typename TAllKey, typename TAllVal>
-    class MapDB_Pod_Pod {
-        static_assert(is_valid_keyval_type<TAllKey>::value, "");
-        static_assert(is_valid_keyval_type<TAllVal>::value, "");
-        
-        DbiWrapper m_dbiWrap;
-    
-    public:
-        explicit MapDB_Pod_Pod(const string &dbName) :m_dbiWrap{dbName} {}
-        explicit MapDB_Pod_Pod(const string &dbName, const unsigned int dbiFlags)
-            :m_dbiWrap{dbName, dbiFlags} {}
-        
-        void put(lmdb::txn &txn, const TAllKey &key, const TAllVal &val) {
-            m_dbiWrap.put(txn, key, val);
+        // The padded elements underneath, if you need them
+        LmdbSpan<Padded> padded() const {return LmdbSpan<Padded>{m_data, m_size};}
+
+        // Writes all size() values densely to dest
+        void copyOut(T *dest) const {
+            detail::copyOutPadded(m_data, m_size, dest);
         }
-        
-        const TAllVal &get(lmdb::txn &txn, const TAllKey &key) {
-            LmdbSpan<unsigned char> sp = m_dbiWrap.get(txn, key);
-            return sp.asType<TAllVal>();
+
+        std::vector<T> toVector() const {
+            auto res = std::vector<T>(m_size);
+            if(m_size) copyOut(&res[0]);
+            return res;
         }
 
-        // TODO add exists method (and test)
+        // dest[i] = (*this)[idxs[i]]
+        void gather(const size_t *idxs, size_t n, T *dest) const {
+            for(size_t i = 0; i < n; ++i) dest[i] = (*this)[idxs[i]];
+        }
     };
 
 
     // ======================================================================
-    // == MapDB_AutoPadded_Pod_Pod ===
+    // == MissingDbError ===
     // ==
-    // ==   Exactly the same as MapDB_Pod_Pod, but wraps your key and value
-    // ==   types in an implicit EightPadded, which gets used behind the scenes
-    // ==   when you call get() and put();
+    // ==   Thrown when a read transaction tries to use a named DB that hasn't
+    // ==   been created in the file yet (a read txn can't create it for you).
     // ==
-    // ==   We give this a slightly longer name than MapDB_Pod_Pod because you
-    // ==   probably want to think about whether the extra padding will have an
-    // ==   effect on your space usage and performance.
-    // ==   For small/simple uses it really won't.
+    // ==   Write to the DB once (or construct its collection against a
+    // ==   DatabaseEnvironment, which creates it up front) to avoid this.
     // ======================================================================
-    
-    template <typename TKey, typename TVal>
-    class MapDB_AutoPadded_Pod_Pod {
-        using PadKey = EightPadded<TKey>;
-        using PadVal = EightPadded<TVal>;
-        
-        MapDB_Pod_Pod<PadKey, PadVal> m_db;
-    
-    public:
-        explicit MapDB_AutoPadded_Pod_Pod(const string &dbName) :m_db{dbName} {}
-        explicit MapDB_AutoPadded_Pod_Pod(const string &dbName, const unsigned int dbiFlags)
-            :m_db{dbName, dbiFlags} {}
-        
-        void put(lmdb::txn &txn, const TKey &key, const TVal &val) {
-            m_db.put(txn, PadKey{key}, PadVal{val});
-        }
-        
-        const TVal &get(lmdb::txn &txn, const TKey &key) {
-            const PadVal &pv = m_db.get(txn, PadKey{key});
-            return *pv;
-        }
 
-        // TODO add exists() method (and test)
+    class MissingDbError : public std::runtime_error {
+    public:
+        explicit MissingDbError(const string &dbName)
+            :std::runtime_error{"lmdbcols: named DB does not exist yet: " + dbName} {}
     };
 
+    namespace detail {
+        // Open a named DB within an existing txn, turning 'doesn't exist' into a
+        // MissingDbError. LMDB gives MDB_NOTFOUND if we didn't ask to create it,
+        // or EACCES if we did but the txn is read-only.
+        inline MDB_dbi openDbiInTxn(MDB_txn *txn, const string &dbName, const unsigned int dbiflags) {
+            MDB_dbi res;
+            const int rc = mdb_dbi_open(txn, dbName.c_str(), dbiflags, &res);
+            if(rc == MDB_NOTFOUND || (rc == EACCES && (dbiflags & MDB_CREATE)))
+                throw MissingDbError{dbName};
+            if(rc) lmdb::error::raise("openDbiInTxn", rc);
+            return res;
+        }
+    }  // namespace detail
+
 
     // ======================================================================
-    // == MapDB_Pod_PodArray ===
+    // == Metrics ===
     // ==
-    // ==   Similar to MapDB_Pod_Pod, but stores an array of values
-    // ==   rather than a single one (TAllValElem is value element type).
+    // ==   Build with LMDBCOLS_ENABLE_METRICS defined and every DbiWrapper
+    // ==   (so every collection) counts its gets, misses, puts and bytes, and
+    // ==   keeps log2-bucketed latency histograms of its gets and puts;
+    // ==   DatabaseEnvironment::write() does the same for its txns.
     // ==
-    // ==   Similarly, for aligment reasons we require that sizeof(TAllKey) and
-    // ==   sizeof(TAllValElem) are both multiples of 8.
+    // ==   Counters are sharded by thread onto separate cache lines, so
+    // ==   threads don't contend on them; reading them sums the shards.
     // ==
-    // ==   get() returns an LmdbSpan, which is just a normal span/view type,
-    // ==   and very easy to use.
+    // ==   Without the define none of that is compiled in at all, and the
+    // ==   snapshots below just come back with their op counts zeroed.
+    // ==
+    // ==   DatabaseEnvironment::stats() works either way, giving LMDB's own
+    // ==   stats: per named DB B-tree shape (depth, leaf / overflow pages...),
+    // ==   reader table use, and how far behind the oldest live reader is.
     // ======================================================================
-    
-    template <typename TAllKey, typename TAllValElem>
-    class MapDB_Pod_PodArray {
-        static_assert(is_valid_keyval_type<TAllKey>::value, "");
-        static_assert(is_valid_keyval_type<TAllValElem>::value, "");
-        
-        DbiWrapper m_dbiWrap;
 
-    public:
-        explicit MapDB_Pod_PodArray(const string &dbName) :m_dbiWrap{dbName} {}
-        explicit MapDB_Pod_PodArray(const string &dbName, const unsigned int dbiFlags)
-            :m_dbiWrap{dbName, dbiFlags} {}
-        
-        // // TODO consider whether I want this one
-        // template <class Range>
-        // void put(lmdb::txn &txn, const TAllKey &key, Range range) {
-        //   static_assert( std::is_same<
-        //                      std::remove_cv_t<TAllValElem>,
-        //                      std::remove_cv_t<typename Range::value_type> >::value,
-        //                  "Calling array put function with range containing wrong value_type" );
-        //   m_dbiWrap.putArray(txn, key, &range[0], range.size()); }
-        
-        LmdbSpan<TAllValElem>
-        get(lmdb::txn &txn, const TAllKey &key) {
-            LmdbSpan<unsigned char> sp = m_dbiWrap.get(txn, key);
-            return sp.asSpan<TAllValElem>();
-        }
-        
-        void put(lmdb::txn &txn, const TAllKey &key, const TAllValElem *data, size_t count) {
-            m_dbiWrap.putArray(txn, key, data, count);
+#ifdef LMDBCOLS_ENABLE_METRICS
+#  define LMDBCOLS_IF_METRICS(...) __VA_ARGS__
+#else
+#  define LMDBCOLS_IF_METRICS(...)
+#endif
+
+    // Bucket i counts ops taking [2^i, 2^(i+1)) ns (bucket 0 also takes 0ns)
+    struct LatencyHistogramSnapshot {
+        static constexpr size_t numBuckets = 64;
+        uint64_t buckets[numBuckets] = {};
+
+        uint64_t count() const {
+            uint64_t res = 0;
+            for(auto b : buckets) res += b;
+            return res;
         }
-        
-        bool exists( lmdb::txn &txn, const TAllKey &key ) {
-            return m_dbiWrap.exists(txn, key);
+
+        // Upper bound (in ns) of the bucket the frac'th op falls in; 0 if none.
+        // The top bucket's bound doesn't fit in 64 bits, so it gives UINT64_MAX.
+        double percentileNanos(double frac) const {
+            const uint64_t total = count();
+            if(!total) return 0;
+            const uint64_t target = static_cast<uint64_t>(frac * (total - 1)) + 1;
+            uint64_t seen = 0;
+            for(size_t i = 0; i < numBuckets; ++i) {
+                seen += buckets[i];
+                if(seen < target) continue;
+                return static_cast<double>(i + 1 < numBuckets ? uint64_t{2} << i : UINT64_MAX);
+            }
+            return 0;
         }
     };
 
+    struct OpMetricsSnapshot {
+        uint64_t gets         = 0;  // Incl. exists() and each getMany() key
+        uint64_t getMisses    = 0;
+        uint64_t puts         = 0;  // Incl. reserves
+        uint64_t bytesRead    = 0;  // Of values
+        uint64_t bytesWritten = 0;
+        LatencyHistogramSnapshot getLatency, putLatency;
+    };
 
-    // ======================================================================
-    // == MapDB_AutoPadded_Pod_PodArray ===
-    // ==
-    // ==   Similar to MapDB_Pod_PodAray, but wraps the user-provided
-    // ==   types in EightPadded automatically to comply with alignment reqs.
-    // ==
-    // ==   Annoyingly, since we return an LmdbSpan on get() giving zero-copy
-    // ==   access to the data in the db, you have to run operator*/get()/cget()
-    // ==   on the members of the span to strop away the EightPadded before you
-    // ==   can work with their actual values - we can't trivially do it
-    // ==   automatically.
-    // ==   I'll probably bring in some kind of facade or iterator to help with
-    // ==   this at some point, if it matters.
-    // ======================================================================
+    struct DbStats {
+        string name;  // Empty for the main (unnamed) DB
+        size_t pageSize = 0, depth = 0;
+        size_t branchPages = 0, leafPages = 0, overflowPages = 0;  // Overflow: values too big for a leaf
+        size_t entries = 0;
+        OpMetricsSnapshot ops;  // Through collections built against the env
+    };
+
+    struct EnvStatsSnapshot {
+        bool metricsEnabled = false;  // Whether op counts below are real
+
+        size_t mapSize = 0, lastPageNo = 0, lastTxnId = 0;
+        size_t maxReaders = 0;
+        size_t readerSlotsUsed = 0;  // High water mark of the reader table
+        size_t activeReaders = 0;    // Read txns live now, in any process
+        size_t oldestReaderLag = 0;  // Commits since the oldest live reader's
+                                     // snapshot; pages freed since can't be reused
+
+        DbStats main;
+        std::vector<DbStats> dbs;  // Every named DB in the file we could open
+        size_t dbsUnlisted = 0;    // Named DBs left out of dbs because the env
+                                   // had no handles left (raise EnvOptions::maxDbs)
+        LatencyHistogramSnapshot writeTxnLatency;  // Of DatabaseEnvironment::write()
+    };
+
+#ifdef LMDBCOLS_ENABLE_METRICS
+    namespace detail {
+        constexpr size_t metricShards = 16;
+
+        inline size_t metricShard() {
+            static thread_local const size_t shard =
+                std::hash<std::thread::id>{}(std::this_thread::get_id()) % metricShards;
+            return shard;
+        }
+
+        inline size_t latencyBucket(uint64_t ns) {
+            size_t res = 0;
+            while(ns >>= 1) ++res;
+            return res;
+        }
+
+        class LatencyHistogram {
+            std::atomic<uint64_t> m_buckets[LatencyHistogramSnapshot::numBuckets];
+        public:
+            LatencyHistogram() {for(auto &b : m_buckets) b.store(0, std::memory_order_relaxed);}
+            void record(uint64_t ns) {
+                m_buckets[latencyBucket(ns)].fetch_add(1, std::memory_order_relaxed);
+            }
+            void addTo(LatencyHistogramSnapshot &snap) const {
+                for(size_t i = 0; i < LatencyHistogramSnapshot::numBuckets; ++i)
+                    snap.buckets[i] += m_buckets[i].load(std::memory_order_relaxed);
+            }
+        };
+
+        class OpMetrics {
+            struct alignas(64) Shard {
+                std::atomic<uint64_t> gets {0}, getMisses {0}, puts {0}, bytesRead {0}, bytesWritten {0};
+                LatencyHistogram getLatency, putLatency;
+            };
+            Shard m_shards[metricShards];
+
+        public:
+            void recordGet(bool found, size_t bytes, uint64_t ns) {
+                Shard &sh = m_shards[metricShard()];
+                sh.gets.fetch_add(1, std::memory_order_relaxed);
+                if(found) sh.bytesRead.fetch_add(bytes, std::memory_order_relaxed);
+                else      sh.getMisses.fetch_add(1, std::memory_order_relaxed);
+                sh.getLatency.record(ns);
+            }
+
+            void recordPut(size_t bytes, uint64_t ns) {
+                Shard &sh = m_shards[metricShard()];
+                sh.puts.fetch_add(1, std::memory_order_relaxed);
+                sh.bytesWritten.fetch_add(bytes, std::memory_order_relaxed);
+                sh.putLatency.record(ns);
+            }
+
+            OpMetricsSnapshot snapshot() const {
+                OpMetricsSnapshot res;
+                for(auto &sh : m_shards) {
+                    res.gets         += sh.gets.load(std::memory_order_relaxed);
+                    res.getMisses    += sh.getMisses.load(std::memory_order_relaxed);
+                    res.puts         += sh.puts.load(std::memory_order_relaxed);
+                    res.bytesRead    += sh.bytesRead.load(std::memory_order_relaxed);
+                    res.bytesWritten += sh.bytesWritten.load(std::memory_order_relaxed);
+                    sh.getLatency.addTo(res.getLatency);
+                    sh.putLatency.addTo(res.putLatency);
+                }
+                return res;
+            }
+        };
+
+        class OpTimer {
+            const std::chrono::steady_clock::time_point m_start = std::chrono::steady_clock::now();
+        public:
+            uint64_t nanos() const {
+                return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - m_start).count();
+            }
+        };
+
+        // One OpMetrics per DB name, shared by every collection on that DB
+        class MetricsRegistry {
+            std::mutex m_mutex;
+            std::vector<std::pair<string, std::shared_ptr<OpMetrics>>> m_dbs;
+        public:
+            LatencyHistogram writeTxnLatency;
+
+            std::shared_ptr<OpMetrics> forDb(const string &name) {
+                std::lock_guard<std::mutex> lock {m_mutex};
+                for(auto &d : m_dbs) if(d.first == name) return d.second;
+                m_dbs.emplace_back(name, std::make_shared<OpMetrics>());
+                return m_dbs.back().second;
+            }
+
+            // Zeros if nothing's recorded against name
+            OpMetricsSnapshot snapshotFor(const string &name) {
+                std::lock_guard<std::mutex> lock {m_mutex};
+                for(auto &d : m_dbs) if(d.first == name) return d.second->snapshot();
+                return OpMetricsSnapshot{};
+            }
+        };
+    }  // namespace detail
+#endif
+
+
+    // ======================================================================
+    // == EnvOptions ===
+    // ==
+    // ==   Settings for opening a DatabaseEnvironment, for when the defaults
+    // ==   aren't what you want. Set the fields you care about and pass it in.
+    // ======================================================================
+
+    struct EnvOptions {
+        static constexpr size_t defaultMaxSize = 1UL * 1024UL * 1024UL * 1024UL; // 1GB
+        static constexpr size_t defaultMaxDbs = 10;  // TODO consider this
+
+        size_t maxSize = defaultMaxSize;
+        size_t maxDbs  = defaultMaxDbs;
+
+        // MDB_NOTLS: live read txns aren't tied to the thread that opened
+        // them, so can be handed between worker threads, and a thread can
+        // hold several. Costs a reader slot per live read txn rather than
+        // per thread.
+        bool noTls = false;
+
+        // Most parked read txns we keep around for reuse (with noTls, each pins a reader slot)
+        size_t maxPooledReadTxns = 64;
+
+        // Map growth, for writes done through DatabaseEnvironment::write().
+        // Off unless growthFactor > 1: then each time the map fills up we
+        // multiply its size by growthFactor (never past maxGrowSize, if set)
+        // and retry the write. Lets you start with a small map.
+        // A resize waits for snapshotTo() copies in progress (without holding
+        // up other txns), so a map that fills during a long copy only grows
+        // if the copy ends within resizeTimeout; otherwise the write fails
+        // with MDB_MAP_FULL. Leave headroom if you snapshot a busy env.
+        double growthFactor = 0;
+        size_t maxGrowSize  = 0;
+
+        // How long a resize waits for this process's read txns to finish
+        // before giving up (and letting the MDB_MAP_FULL through)
+        std::chrono::milliseconds resizeTimeout {5000};
+
+        // -- Durability vs speed. All off is LMDB's default: every commit
+        //    is synced to disk before it returns.
+        //
+        //    noSync (MDB_NOSYNC): commits don't sync at all; a system crash
+        //        can lose recent commits, or with writeMap corrupt the DB.
+        //    noMetaSync (MDB_NOMETASYNC): skip the meta page sync; a crash can
+        //        lose the last commit, but not consistency.
+        //    writeMap (MDB_WRITEMAP): write through a writable map rather
+        //        than write(); faster commits, but stray pointers can now
+        //        scribble on the DB.
+        //    mapAsync (MDB_MAPASYNC): with writeMap, flush asynchronously.
+        //    noReadahead (MDB_NORDAHEAD): no OS readahead; helps random reads
+        //        on DBs bigger than RAM.
+        //    noMemInit (MDB_NOMEMINIT): don't zero malloc'd pages before
+        //        writing them out (no effect with writeMap).
+        //
+        //    With syncInterval > 0 a background thread calls sync() that
+        //    often, bounding how much the async modes can lose to a crash.
+        bool writeMap    = false;
+        bool noSync      = false;
+        bool noMetaSync  = false;
+        bool mapAsync    = false;
+        bool noReadahead = false;
+        bool noMemInit   = false;
+        std::chrono::milliseconds syncInterval {0};
+
+        // The DB path is a file rather than a directory (MDB_NOSUBDIR)
+        bool   noSubDir = true;
+        mdb_mode_t fileMode = 0664;
+
+        // The mdb_env_open() flags these options add up to
+        unsigned int envFlags() const {
+            return (noSubDir    ? MDB_NOSUBDIR   : 0)
+                |  (noTls       ? MDB_NOTLS      : 0)
+                |  (writeMap    ? MDB_WRITEMAP   : 0)
+                |  (noSync      ? MDB_NOSYNC     : 0)
+                |  (noMetaSync  ? MDB_NOMETASYNC : 0)
+                |  (mapAsync    ? MDB_MAPASYNC   : 0)
+                |  (noReadahead ? MDB_NORDAHEAD  : 0)
+                |  (noMemInit   ? MDB_NOMEMINIT  : 0);
+        }
+    };
+
+
+    // ======================================================================
+    // == ReadTxnPool ===
+    // ==
+    // ==   Recycles read txns for an environment, so that opening one on a hot
+    // ==   path is an mdb_txn_renew() rather than a full mdb_txn_begin(), which
+    // ==   has to find and claim a reader slot.
+    // ==
+    // ==   Finished txns are parked with mdb_txn_reset() (which drops their
+    // ==   snapshot, so they don't pin old pages) and renewed on next use.
+    // ==
+    // ==   Without MDB_NOTLS a parked txn holds no reader slot and renewing
+    // ==   claims the renewing thread's; with it, the txn keeps its own slot
+    // ==   whichever thread renews it. Either way any thread can take
+    // ==   any parked txn. As with openReadTxn(), without MDB_NOTLS a thread
+    // ==   mustn't already have a live read txn on the env when it takes one.
+    // ==
+    // ==   You don't use this directly; see DatabaseEnvironment::acquireReadTxn().
+    // ======================================================================
+
+    struct ReadTxnPoolStats {
+        size_t hits          = 0;  // Served by renewing a parked txn
+        size_t misses        = 0;  // Had to begin a new txn
+        size_t renewFailures = 0;  // Parked txn wouldn't renew; we began a new one
+        size_t staleReaders  = 0;  // Dead processes' reader slots we've cleared
+        size_t parked        = 0;  // Txns currently parked
+    };
+
+    namespace detail {
+        // Lets a map resize shut out new txns in this process: LMDB requires
+        // that none be active while the map is swapped for a bigger one.
+        // Txn begins go through enter()/leave(); close() stops new ones
+        // getting in and waits for those already part way through.
+        class TxnGate {
+            std::atomic<bool>   m_closed{false};
+            std::atomic<size_t> m_entering{0};
+            std::mutex m_mutex;
+            std::condition_variable m_cv;
+
+        public:
+            void enter() {
+                for(;;) {
+                    ++m_entering;
+                    if(! m_closed) return;
+                    --m_entering;
+                    std::unique_lock<std::mutex> lock {m_mutex};
+                    m_cv.wait(lock, [this]{ return ! m_closed; });
+                }
+            }
+
+            void leave() {--m_entering;}
+
+            void close() {
+                m_closed = true;
+                while(m_entering) std::this_thread::yield();
+            }
+
+            void open() {
+                {
+                    std::lock_guard<std::mutex> lock {m_mutex};
+                    m_closed = false;
+                }
+                m_cv.notify_all();
+            }
+        };
+
+        // What an env needs to grow its map (kept on the heap so the env stays movable)
+        struct MapGrowth {
+            TxnGate gate;
+            std::mutex growMutex;  // One resize at a time
+            std::atomic<size_t> growths {0};
+            std::atomic<size_t> snapshots {0};  // Env copies in progress (see SnapshotGuard)
+        };
+
+        // Scoped enter()/leave(); no-op without a gate (growth disabled)
+        class TxnGateGuard {
+            TxnGate *m_gate;
+        public:
+            explicit TxnGateGuard(TxnGate *gate) :m_gate{gate} {if(m_gate) m_gate->enter();}
+            ~TxnGateGuard() {if(m_gate) m_gate->leave();}
+            TxnGateGuard(const TxnGateGuard &) = delete;
+            TxnGateGuard &operator=(const TxnGateGuard &) = delete;
+        };
+
+        // Marks an env copy as in progress for its scope. A copy can take
+        // minutes, so rather than holding the gate throughout (which would
+        // stall every txn behind a waiting resize) it passes the gate once to
+        // register, and a resize waits for the count to drop with the gate
+        // still open. No-op without growth.
+        class SnapshotGuard {
+            MapGrowth *m_growth;
+        public:
+            explicit SnapshotGuard(MapGrowth *growth) :m_growth{growth} {
+                if(! m_growth) return;
+                TxnGateGuard gateGuard {&m_growth->gate};
+                ++m_growth->snapshots;
+            }
+            ~SnapshotGuard() {if(m_growth) --m_growth->snapshots;}
+            SnapshotGuard(const SnapshotGuard &) = delete;
+            SnapshotGuard &operator=(const SnapshotGuard &) = delete;
+        };
+
+        inline int currentPid() {
+#ifdef _WIN32
+            return _getpid();
+#else
+            return getpid();
+#endif
+        }
+
+        // Number of read txns this process has open on env right now (parked
+        // pooled txns don't count), going by LMDB's reader table
+        inline size_t activeReadersInProcess(MDB_env *env) {
+            struct Ctx { int pid; size_t count; } ctx {currentPid(), 0};
+            // Lines look like "<pid> <thread> <txnid>", txnid "-" if idle
+            const int rc = mdb_reader_list(env, [](const char *msg, void *vctx) -> int {
+                    auto ctx = static_cast<Ctx *>(vctx);
+                    int pid; char txnid[32];
+                    if(sscanf(msg, "%d %*s %31s", &pid, txnid) == 2
+                       && pid == ctx->pid && strcmp(txnid, "-"))
+                        ++ctx->count;
+                    return 0; }, &ctx);
+            if(rc < 0) lmdb::error::raise("activeReadersInProcess", rc);
+            return ctx.count;
+        }
+
+        class ReadTxnPool {
+            MDB_env *const m_env;
+            TxnGate *const m_gate;  // nullptr if map growth is off
+            const size_t m_maxParked;
+
+            std::mutex m_mutex;
+            std::vector<MDB_txn *> m_parked;
+            std::atomic<size_t> m_hits{0}, m_misses{0}, m_renewFailures{0}, m_staleReaders{0};
+
+            // The most recently parked txn (likeliest to be warm), or nullptr
+            MDB_txn *takeParked() {
+                std::lock_guard<std::mutex> lock {m_mutex};
+                if(m_parked.empty()) return nullptr;
+                MDB_txn *res = m_parked.back();
+                m_parked.pop_back();
+                return res;
+            }
+
+            // Keeps a reset txn for reuse, or aborts it if the pool's full
+            void park(MDB_txn *txn) {
+                {
+                    std::lock_guard<std::mutex> lock {m_mutex};
+                    if(m_parked.size() < m_maxParked) {
+                        m_parked.push_back(txn);
+                        return;
+                    }
+                }
+                mdb_txn_abort(txn);
+            }
+
+        public:
+            explicit ReadTxnPool(MDB_env *env, TxnGate *gate, size_t maxParked)
+                :m_env{env}, m_gate{gate}, m_maxParked{maxParked} {}
+
+            ReadTxnPool(const ReadTxnPool &) = delete;
+            ReadTxnPool &operator=(const ReadTxnPool &) = delete;
+
+            ~ReadTxnPool() {
+                for(MDB_txn *txn : m_parked) mdb_txn_abort(txn);
+            }
+
+            MDB_txn *take() {
+                TxnGateGuard gateGuard {m_gate};
+                if(MDB_txn *txn = takeParked()) {
+                    const int rc = mdb_txn_renew(txn);
+                    if(! rc) {
+                        ++m_hits;
+                        return txn;
+                    }
+                    if(rc == MDB_BAD_RSLOT) {
+                        // This thread already has a live read txn; a begin
+                        // would fail the same way, and the txn's still good
+                        park(txn);
+                        lmdb::error::raise("ReadTxnPool txn renew", rc);
+                    }
+                    mdb_txn_abort(txn);
+                    ++m_renewFailures;
+                }
+                ++m_misses;
+
+                MDB_txn *txn;
+                int rc = mdb_txn_begin(m_env, nullptr, MDB_RDONLY, &txn);
+                if(rc == MDB_READERS_FULL) {
+                    // Slots may be held by processes that died mid-txn
+                    clearStaleReaders();
+                    rc = mdb_txn_begin(m_env, nullptr, MDB_RDONLY, &txn);
+                }
+                if(rc) lmdb::error::raise("ReadTxnPool txn begin", rc);
+                return txn;
+            }
+
+            void give(MDB_txn *txn) {
+                mdb_txn_reset(txn);
+                park(txn);
+            }
+
+            size_t clearStaleReaders() {
+                int dead = 0;
+                const int rc = mdb_reader_check(m_env, &dead);
+                if(rc) lmdb::error::raise("ReadTxnPool reader check", rc);
+                m_staleReaders += dead;
+                return dead;
+            }
+
+            ReadTxnPoolStats stats() {
+                ReadTxnPoolStats res;
+                res.hits = m_hits; res.misses = m_misses;
+                res.renewFailures = m_renewFailures; res.staleReaders = m_staleReaders;
+                std::lock_guard<std::mutex> lock {m_mutex};
+                res.parked = m_parked.size();
+                return res;
+            }
+        };
+
+        // Calls mdb_env_sync() every interval on a thread of its own, for
+        // EnvOptions::syncInterval. Goes through the gate, so it never
+        // syncs mid map resize.
+        class SyncScheduler {
+            MDB_env *m_env;
+            TxnGate *m_gate;
+            const std::chrono::milliseconds m_interval;
+
+            std::mutex m_mutex;
+            std::condition_variable m_cv;
+            bool m_stopping = false;
+            std::atomic<size_t> m_syncs {0}, m_failures {0};
+            std::thread m_thread;
+
+            void run() {
+                std::unique_lock<std::mutex> lock {m_mutex};
+                while(! m_cv.wait_for(lock, m_interval, [this] {return m_stopping;})) {
+                    lock.unlock();
+                    int rc;
+                    {
+                        TxnGateGuard gateGuard {m_gate};
+                        rc = mdb_env_sync(m_env, 1);
+                    }
+                    (rc ? m_failures : m_syncs).fetch_add(1);
+                    lock.lock();
+                }
+            }
+
+        public:
+            explicit SyncScheduler(MDB_env *env, TxnGate *gate, std::chrono::milliseconds interval)
+                :m_env{env}, m_gate{gate}, m_interval{interval},
+                 m_thread{[this] {run();}} {}
+
+            ~SyncScheduler() {
+                {
+                    std::lock_guard<std::mutex> lock {m_mutex};
+                    m_stopping = true;
+                }
+                m_cv.notify_one();
+                m_thread.join();
+            }
+
+            size_t syncs()    const {return m_syncs.load();}
+            size_t failures() const {return m_failures.load();}
+        };
+    }  // namespace detail
+
+
+    // ======================================================================
+    // == PooledReadTxn ===
+    // ==
+    // ==   A read txn on loan from a ReadTxnPool. Use it exactly like the
+    // ==   lmdb::txn you'd get from openReadTxn(); when it goes out of scope
+    // ==   it's parked for reuse rather than aborted.
+    // ==
+    // ==   (If you commit() or abort() it yourself it just isn't recycled.)
+    // ==   Mustn't outlive its DatabaseEnvironment.
+    // ======================================================================
+
+    class PooledReadTxn : public lmdb::txn {
+        detail::ReadTxnPool *m_pool;
+
+    public:
+        explicit PooledReadTxn(detail::ReadTxnPool &pool)
+            :lmdb::txn{pool.take()}, m_pool{&pool} {}
+
+        PooledReadTxn(PooledReadTxn &&o) noexcept :lmdb::txn{std::move(o)}, m_pool{o.m_pool} {}
+
+        ~PooledReadTxn() noexcept {
+            if(_handle) {
+                m_pool->give(_handle);
+                _handle = nullptr;
+            }
+        }
+    };
+
+
+    // For DatabaseEnvironment::adviseMap(); as the madvise() flags
+    enum class MapAdvice { Normal, Random, Sequential, WillNeed };
+
+    namespace detail {
+        // Start of the env's map within our address space, or nullptr if
+        // there's no data yet. LMDB doesn't tell us (me_mapaddr is only set
+        // for MDB_FIXEDMAP), but every page in the file starts with its own
+        // page number, so any page a read txn hands us a pointer into will do.
+        inline char *mapBase(lmdb::txn &txn, size_t psize) {
+            MDB_dbi mainDbi;
+            int rc = mdb_dbi_open(txn, nullptr, 0, &mainDbi);
+            if(rc) lmdb::error::raise("mapBase open main DB", rc);
+            auto cursor = lmdb::cursor::open(txn, mainDbi);
+            MDB_val mkey, mval;
+            rc = mdb_cursor_get(cursor, &mkey, &mval, MDB_FIRST);
+            if(rc == MDB_NOTFOUND) return nullptr;
+            if(rc) lmdb::error::raise("mapBase seek", rc);
+            // Keys always live in a leaf page, never an overflow one
+            const auto addr = reinterpret_cast<std::uintptr_t>(mkey.mv_data);
+            char *page = reinterpret_cast<char *>(addr - addr % psize);
+            size_t pgno;
+            memcpy(&pgno, page, sizeof(pgno));
+            return page - pgno * psize;
+        }
+    }
+
+    // Result of DatabaseEnvironment::snapshotTo()
+    struct SnapshotStats {
+        size_t bytes   = 0;  // Size of the copy
+        double seconds = 0;
+
+        double bytesPerSec() const {return seconds > 0 ? bytes / seconds : 0;}
+    };
+
+
+    // ======================================================================
+    // == DatabaseEnvironment ===
+    // ==
+    // ==   Simplified wrapper around MDB_env / lmdb::env.
+    // ==   Assumes you want a bare db file, rather than a directory.
+    // ==
+    // ==   Makes reasonably sensible guesses about maxDBs and map size (which
+    // ==   you can override, see EnvOptions).
+    // ==   Also lets you open read/readwrite transactions easily.
+    // ==
+    // ==   NB we round the requested mapsize up to the next multiple of 4096,
+    // ==   as the DB requires it and most callers don't care.
+    // ======================================================================
+    
+    class DatabaseEnvironment {
+        EnvOptions m_opts;
+        lmdb::env m_env;
+        std::unique_ptr<detail::MapGrowth> m_growth;  // Only if map growth is on
+        std::unique_ptr<detail::ReadTxnPool> m_readPool;  // Must die before m_env
+        std::unique_ptr<detail::SyncScheduler> m_syncer;  // Likewise; only with a syncInterval
+        LMDBCOLS_IF_METRICS( std::unique_ptr<detail::MetricsRegistry> m_metrics {new detail::MetricsRegistry}; )
+
+        detail::TxnGate *gate() {return m_growth ? &m_growth->gate : nullptr;}
+
+        // Makes the map bigger, if growth is on and nobody else has since
+        // sizeAtFailure was seen. Returns whether it's worth retrying.
+        bool growMap(size_t sizeAtFailure) {
+            if(! m_growth) return false;
+            std::lock_guard<std::mutex> lock {m_growth->growMutex};
+            const size_t current = mapSize();
+            if(current > sizeAtFailure) return true;
+            
+            size_t target = static_cast<size_t>(current * m_opts.growthFactor);
+            if(m_opts.maxGrowSize && target > m_opts.maxGrowSize) target = m_opts.maxGrowSize;
+            target -= target % 4096;
+            if(target <= current) return false;
+            return resizeMap(target);
+        }
+
+        // Resize needs every txn in this process to be finished, so hold new
+        // ones at the gate and wait for the rest to drain (LMDB refuses with
+        // EINVAL while a write txn is open).
+        // Snapshots in progress are waited out first with the gate open, so
+        // other txns carry on meanwhile; one that outlasts resizeTimeout
+        // makes us give up.
+        bool resizeMap(size_t newSize) {
+            const auto deadline = std::chrono::steady_clock::now() + m_opts.resizeTimeout;
+            for(;;) {
+                if(m_growth->snapshots) {
+                    if(std::chrono::steady_clock::now() > deadline) return false;
+                    std::this_thread::sleep_for(std::chrono::milliseconds{1});
+                    continue;
+                }
+
+                m_growth->gate.close();
+                struct Reopen { detail::TxnGate &g; ~Reopen() {g.open();} } reopen {m_growth->gate};
+                if(m_growth->snapshots) continue;  // One registered before we closed
+
+                for(;;) {
+                    if(! detail::activeReadersInProcess(m_env)) {
+                        const int rc = mdb_env_set_mapsize(m_env, newSize);
+                        if(! rc) {
+                            ++m_growth->growths;
+                            return true;
+                        }
+                        if(rc != EINVAL) lmdb::error::raise("DatabaseEnvironment resize", rc);
+                    }
+                    if(std::chrono::steady_clock::now() > deadline) return false;
+                    std::this_thread::sleep_for(std::chrono::milliseconds{1});
+                }
+            }
+        }
+
+        static EnvOptions optsWithSizes(size_t maxSize, size_t maxDbs) {
+            EnvOptions res;
+            res.maxSize = maxSize; res.maxDbs = maxDbs;
+            return res;
+        }
+    
+    public:
+        explicit DatabaseEnvironment(const string &dbPath,
+                                     size_t maxSize = EnvOptions::defaultMaxSize,
+                                     size_t maxDbs = EnvOptions::defaultMaxDbs)
+                :DatabaseEnvironment{dbPath, optsWithSizes(maxSize, maxDbs)} {}
+
+        explicit DatabaseEnvironment(const string &dbPath, const EnvOptions &opts)
+                :m_opts(opts), m_env{lmdb::env::create()}
+        {
+            const size_t maxSize = opts.maxSize;
+            m_env.set_mapsize((maxSize % 4096 == 0)
+                              ? maxSize
+                              : (maxSize + 4096 - (maxSize%4096)));
+            m_env.set_max_dbs(opts.maxDbs);
+            m_env.open(dbPath.c_str(), opts.envFlags(), opts.fileMode);
+            if(opts.growthFactor > 1) m_growth.reset(new detail::MapGrowth);
+            m_readPool.reset(new detail::ReadTxnPool{m_env.handle(), gate(), opts.maxPooledReadTxns});
+            if(opts.syncInterval.count() > 0)
+                m_syncer.reset(new detail::SyncScheduler{m_env.handle(), gate(), opts.syncInterval});
+        }
+
+        lmdb::txn openWriteTxn() {
+            detail::TxnGateGuard gateGuard {gate()};
+            return lmdb::txn::begin(m_env, nullptr);
+        }
+        lmdb::txn openReadTxn() {
+            detail::TxnGateGuard gateGuard {gate()};
+            return lmdb::txn::begin(m_env, nullptr, MDB_RDONLY);
+        }
+
+        // Runs fn(lmdb::txn &) in a write txn and commits it.
+        // If the map fills up along the way and growth is on (see EnvOptions),
+        // grows the map and runs fn again in a fresh txn, so fn must be fine
+        // to run more than once. Also picks up a map grown by another process.
+        // NB the resize waits for this process's other txns to finish, so
+        // don't call this while holding one on the same thread.
+        template <typename Fn>
+        void write(Fn fn) {
+            LMDBCOLS_IF_METRICS( detail::OpTimer timer;
+                                 struct Record { detail::OpTimer &t; detail::MetricsRegistry &r;
+                                                 ~Record() {r.writeTxnLatency.record(t.nanos());} }
+                                 record {timer, *m_metrics}; )
+            for(;;) {
+                const size_t sizeAtStart = mapSize();
+                try {
+                    auto txn = openWriteTxn();
+                    fn(txn);
+                    txn.commit();
+                    return;
+                }
+                catch(const lmdb::map_full_error &) {
+                    if(! growMap(sizeAtStart)) throw;
+                }
+                catch(const lmdb::error &e) {
+                    if(e.code() != MDB_MAP_RESIZED || ! m_growth) throw;
+                    // Another process grew it; zero means adopt their size
+                    if(! resizeMap(0)) throw;
+                }
+            }
+        }
+
+        size_t mapSize() const {
+            MDB_envinfo info;
+            const int rc = mdb_env_info(m_env, &info);
+            if(rc) lmdb::error::raise("DatabaseEnvironment env info", rc);
+            return info.me_mapsize;
+        }
+
+        // Times write() has had to grow the map
+        size_t mapGrowths() const {return m_growth ? m_growth->growths.load() : 0;}
+
+        // Read txn recycled through this env's ReadTxnPool; cheaper than
+        // openReadTxn() when you're opening lots of short-lived ones
+        PooledReadTxn acquireReadTxn() {return PooledReadTxn{*m_readPool};}
+
+        ReadTxnPoolStats readTxnPoolStats() {return m_readPool->stats();}
+
+        // Free up reader slots held by processes that died mid-txn.
+        // Returns how many were cleared.
+        size_t clearStaleReaders() {return m_readPool->clearStaleReaders();}
+
+        MDB_env *handle() const {return m_env.handle();}
+
+        // Flushes written data to disk: needed for durability under noSync
+        // or mapAsync. force=false only syncs if the env flags would anyway.
+        void sync(bool force = true) {
+            detail::TxnGateGuard gateGuard {gate()};
+            const int rc = mdb_env_sync(m_env, force ? 1 : 0);
+            if(rc) lmdb::error::raise("DatabaseEnvironment sync", rc);
+        }
+
+        // Consistent copy of the whole env to a new file at path (a dir, if
+        // noSubDir is off), e.g. to ship to another host. Runs in a read txn,
+        // so readers and writers carry on meanwhile. compact leaves out free
+        // pages and renumbers the rest, so the copy can be much smaller than
+        // the map file; without it, pages are copied as they are (faster).
+        // Uses a read txn, so (without noTls) not while this thread has one.
+        SnapshotStats snapshotTo(const string &path, bool compact = true) {
+            const auto start = std::chrono::steady_clock::now();
+            {
+                detail::SnapshotGuard snapGuard {m_growth.get()};
+                const int rc = mdb_env_copy2(m_env, path.c_str(), compact ? MDB_CP_COMPACT : 0);
+                if(rc) lmdb::error::raise("DatabaseEnvironment snapshot", rc);
+            }
+            SnapshotStats res;
+            std::ifstream copied {m_opts.noSubDir ? path : path + "/data.mdb",
+                                  std::ios::binary | std::ios::ate};
+            if(copied) res.bytes = static_cast<size_t>(copied.tellg());
+            res.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            return res;
+        }
+
+        // madvise()s bytes [offset, offset + len) of the data file's mapping
+        // (clamped to the part in use) and returns how many that was: 0 with
+        // no data yet, or no madvise on this platform.
+        //   - WillNeed starts the OS reading it in, for warm-up (see WarmUp)
+        //   - Random turns off readahead for a DB much bigger than RAM read
+        //     at random, as EnvOptions::noReadahead does at open (but lasts
+        //     only until the map is next grown)
+        // Uses a read txn, so (without noTls) not while this thread has one.
+        size_t adviseMap(MapAdvice advice, size_t offset = 0, size_t len = ~size_t(0)) {
+#ifdef LMDBCOLS_HAVE_MADVISE
+            MDB_envinfo info;
+            MDB_stat st;
+            int rc = mdb_env_info(m_env, &info);
+            if(rc) lmdb::error::raise("DatabaseEnvironment advise env info", rc);
+            rc = mdb_env_stat(m_env, &st);
+            if(rc) lmdb::error::raise("DatabaseEnvironment advise env stat", rc);
+
+            // Held while we use map addresses: a resize waits for it, so the
+            // map can't move under us
+            auto txn = openReadTxn();
+            char *base = detail::mapBase(txn, st.ms_psize);
+            const size_t used = (info.me_last_pgno + 1) * st.ms_psize;
+            offset -= offset % st.ms_psize;
+            if(! base || offset >= used) return 0;
+            if(len > used - offset) len = used - offset;
+
+            const int flag = advice == MapAdvice::Random     ? MADV_RANDOM
+                           : advice == MapAdvice::Sequential ? MADV_SEQUENTIAL
+                           : advice == MapAdvice::WillNeed   ? MADV_WILLNEED
+                           :                                   MADV_NORMAL;
+            if(madvise(base + offset, len, flag))
+                lmdb::error::raise("DatabaseEnvironment madvise", errno);
+            return len;
+#else
+            (void)advice; (void)offset; (void)len;
+            return 0;
+#endif
+        }
+
+        // As snapshotTo(), but written to an open file, pipe or socket
+        void snapshotToFd(mdb_filehandle_t fd, bool compact = true) {
+            detail::SnapshotGuard snapGuard {m_growth.get()};
+            const int rc = mdb_env_copyfd2(m_env, fd, compact ? MDB_CP_COMPACT : 0);
+            if(rc) lmdb::error::raise("DatabaseEnvironment snapshot to fd", rc);
+        }
+
+#ifdef LMDBCOLS_ENABLE_METRICS
+        // Where DbiWrappers built against this env record their ops
+        detail::MetricsRegistry &metricsRegistry() {return *m_metrics;}
+#endif
+
+        // LMDB's stats for the env and every named DB in it, plus op metrics
+        // if they're compiled in (see LMDBCOLS_ENABLE_METRICS).
+        // Opens each named DB to stat it, which LMDB doesn't allow alongside
+        // other threads opening DBs, so don't call this while collections are
+        // being constructed (or used by name only) on other threads.
+        // Uses a read txn, so (without noTls) not while this thread has one.
+        EnvStatsSnapshot stats() {
+            EnvStatsSnapshot res;
+            LMDBCOLS_IF_METRICS( res.metricsEnabled = true; )
+
+            MDB_envinfo info;
+            int rc = mdb_env_info(m_env, &info);
+            if(rc) lmdb::error::raise("DatabaseEnvironment stats env info", rc);
+            res.mapSize = info.me_mapsize;
+            res.lastPageNo = info.me_last_pgno;
+            res.lastTxnId = info.me_last_txnid;
+            res.maxReaders = info.me_maxreaders;
+            res.readerSlotsUsed = info.me_numreaders;
+
+            // Reader table lines look like "<pid> <thread> <txnid>", txnid "-" if idle
+            struct Ctx { size_t active; size_t oldest; } ctx {0, res.lastTxnId};
+            rc = mdb_reader_list(m_env, [](const char *msg, void *vctx) -> int {
+                    auto ctx = static_cast<Ctx *>(vctx);
+                    unsigned long long txnid;
+                    if(sscanf(msg, "%*d %*s %llu", &txnid) == 1) {
+                        ++ctx->active;
+                        if(txnid < ctx->oldest) ctx->oldest = static_cast<size_t>(txnid);
+                    }
+                    return 0; }, &ctx);
+            if(rc < 0) lmdb::error::raise("DatabaseEnvironment stats reader list", rc);
+            res.activeReaders = ctx.active;
+            res.oldestReaderLag = res.lastTxnId - ctx.oldest;
+
+            auto fill = [](DbStats &d, const MDB_stat &st) {
+                d.pageSize = st.ms_psize;
+                d.depth = st.ms_depth;
+                d.branchPages = st.ms_branch_pages;
+                d.leafPages = st.ms_leaf_pages;
+                d.overflowPages = st.ms_overflow_pages;
+                d.entries = st.ms_entries;
+            };
+            MDB_stat st;
+            rc = mdb_env_stat(m_env, &st);
+            if(rc) lmdb::error::raise("DatabaseEnvironment stats env stat", rc);
+            fill(res.main, st);
+
+            // Named DBs are the keys of the main DB (anything else there
+            // won't open as a DB, and is skipped)
+            auto txn = openReadTxn();
+            MDB_dbi mainDbi;
+            rc = mdb_dbi_open(txn, nullptr, 0, &mainDbi);
+            if(rc) lmdb::error::raise("DatabaseEnvironment stats main DB", rc);
+            auto cursor = lmdb::cursor::open(txn, mainDbi);
+            MDB_val mkey, mval;
+            for(MDB_cursor_op op = MDB_FIRST; ! mdb_cursor_get(cursor, &mkey, &mval, op); op = MDB_NEXT) {
+                const string name {static_cast<const char *>(mkey.mv_data), mkey.mv_size};
+                if(name.find('\0') != string::npos) continue;
+                MDB_dbi dbi;
+                rc = mdb_dbi_open(txn, name.c_str(), 0, &dbi);
+                if(rc == MDB_DBS_FULL) ++res.dbsUnlisted;
+                if(rc) continue;
+                if(mdb_stat(txn, dbi, &st)) continue;
+                DbStats d;
+                d.name = name;
+                fill(d, st);
+                LMDBCOLS_IF_METRICS( d.ops = m_metrics->snapshotFor(name); )
+                res.dbs.push_back(d);
+            }
+            LMDBCOLS_IF_METRICS( m_metrics->writeTxnLatency.addTo(res.writeTxnLatency); )
+            return res;
+        }
+
+        // Syncs done / failed by the syncInterval thread so far
+        size_t backgroundSyncs()        const {return m_syncer ? m_syncer->syncs() : 0;}
+        size_t backgroundSyncFailures() const {return m_syncer ? m_syncer->failures() : 0;}
+
+        // Resolve a named DB's handle in a txn of its own, and commit it so the
+        // handle lives in the environment for good (LMDB closes handles first
+        // opened in a txn that gets aborted).
+        // Creates the DB if dbiflags has MDB_CREATE, else throws MissingDbError
+        // if it isn't there.
+        // NB takes the write lock when creating, so don't call this while
+        // holding a write txn on the same thread.
+        MDB_dbi openDbi(const string &dbName, const unsigned int dbiflags) {
+            auto txn = (dbiflags & MDB_CREATE) ? openWriteTxn() : openReadTxn();
+            const MDB_dbi res = detail::openDbiInTxn(txn, dbName, dbiflags);
+            txn.commit();
+            return res;
+        }
+    };
+
+
+    namespace detail {
+        inline size_t osPageSize() {
+#ifdef LMDBCOLS_HAVE_MADVISE
+            static const size_t res = sysconf(_SC_PAGESIZE);
+            return res;
+#else
+            return 4096;
+#endif
+        }
+
+        // Hint to the OS that we'll soon read the memory behind mv. With
+        // onlyIfBig, skips values small enough to sit inside a single page
+        // (which looking them up will have paged in already).
+        inline void adviseWillNeed(const MDB_val &mv, bool onlyIfBig = false) {
+#ifdef LMDBCOLS_HAVE_MADVISE
+            const size_t psize = osPageSize();
+            if(onlyIfBig && mv.mv_size <= psize / 2) return;
+            const auto start = reinterpret_cast<std::uintptr_t>(mv.mv_data);
+            const auto pageStart = start - (start % psize);
+            madvise(reinterpret_cast<void *>(pageStart),
+                    start + mv.mv_size - pageStart, MADV_WILLNEED);
+#else
+            (void)mv; (void)onlyIfBig;
+#endif
+        }
+    }  // namespace detail
+
+
+    // ======================================================================
+    // == DbiWrapper ===
+    // ==
+    // ==   Wrapper around MDB_dbi / lmdb::dbi, with a bit more functionality
+    // ==   that we neeed, as explicitly as possible.
+    // ==   Clients are very unlikely to want to use this class.
+    // ==
+    // ==   NB doesn't hande issues like alignment - just dumbly handles groups
+    // ==   of bytes.
+    // ==
+    // ==   If constructed against a DatabaseEnvironment we resolve the DB handle
+    // ==   once, up front, and every later access just uses it.
+    // ==   If constructed from just a name we have to look the handle up by name
+    // ==   in each txn (mdb_dbi_open), which is noticeably slower on hot paths;
+    // ==   we can't safely cache it there, as LMDB invalidates a handle if the
+    // ==   txn that first opened it gets aborted.
+    // ======================================================================
+    
+    class DbiWrapper {
+    public:
+        static constexpr unsigned int default_dbiflags = (MDB_CREATE);
+
+    private:
+        const string m_dbName;
+        const unsigned int m_dbiflags = default_dbiflags;
+
+        // Set iff we resolved the handle against an env at construction
+        MDB_env *m_env = nullptr;
+        MDB_dbi  m_dbi = 0;
+
+        // Shared with every other wrapper on this DB in the env (see Metrics)
+        LMDBCOLS_IF_METRICS( std::shared_ptr<detail::OpMetrics> m_metrics; )
+    
+        MDB_dbi dbi(lmdb::txn &txn) {
+            if(m_env) {
+                assert( mdb_txn_env(txn) == m_env );
+                return m_dbi;
+            }
+            return detail::openDbiInTxn(txn, m_dbName, m_dbiflags);
+        }
+    
+    public:
+        explicit DbiWrapper(const string &dbName, const unsigned int dbiflags=default_dbiflags)
+            :m_dbName{dbName}, m_dbiflags{dbiflags}
+        {
+            LMDBCOLS_IF_METRICS( m_metrics = std::make_shared<detail::OpMetrics>(); )
+        }
+
+        explicit DbiWrapper(DatabaseEnvironment &env, const string &dbName,
+                            const unsigned int dbiflags=default_dbiflags)
+            :m_dbName{dbName}, m_dbiflags{dbiflags},
+             m_env{env.handle()}, m_dbi{env.openDbi(dbName, dbiflags)}
+        {
+            LMDBCOLS_IF_METRICS( m_metrics = env.metricsRegistry().forDb(dbName); )
+        }
+
+        const string &name() const {return m_dbName;}
+
+        // Ops through this wrapper (and any others on the same DB and env);
+        // all zero unless built with LMDBCOLS_ENABLE_METRICS
+        OpMetricsSnapshot metrics() const {
+#ifdef LMDBCOLS_ENABLE_METRICS
+            return m_metrics->snapshot();
+#else
+            return OpMetricsSnapshot{};
+#endif
+        }
+
+        // Handle to use for this DB within txn (for cursors and the like)
+        MDB_dbi handle(lmdb::txn &txn) {return dbi(txn);}
+
+        // --- Putting
+    
+        template <typename K, typename V>
+        void put(lmdb::txn &txn, const K &key, const V &val) {
+            // TODO idiomatic casts
+            MDB_val mkey {sizeof(key), (void*)(&key)};
+            MDB_val mval {sizeof(val), (void*)(&val)};
+            LMDBCOLS_IF_METRICS( detail::OpTimer timer; )
+            auto rc = mdb_put(txn, dbi(txn), &mkey, &mval, 0);
+            if(rc) lmdb::error::raise("DbiWrapper PUT error", rc);
+            LMDBCOLS_IF_METRICS( m_metrics->recordPut(mval.mv_size, timer.nanos()); )
+        }
+
+        template <typename K, typename VElem>
+        void putArray(lmdb::txn &txn, const K &key, const VElem *dat, size_t count) {
+            // TODO idiomatic casts
+            MDB_val mkey {sizeof(key), (void*)&key};
+            MDB_val mval {sizeof(dat[0])*count, (void*)dat};
+            LMDBCOLS_IF_METRICS( detail::OpTimer timer; )
+            auto rc = mdb_put(txn, dbi(txn), &mkey, &mval, 0);
+            if(rc) lmdb::error::raise("DbiWraper PUT ARRAY error", rc);
+            LMDBCOLS_IF_METRICS( m_metrics->recordPut(mval.mv_size, timer.nanos()); )
+        }
+
+        // Put with MDB_RESERVE: LMDB makes room for count VElems and hands
+        // it back for the caller to fill in (not allowed on DUPSORT DBs)
+        template <typename K, typename VElem>
+        LmdbWriteSpan<VElem> reserveArray(lmdb::txn &txn, const K &key, size_t count) {
+            MDB_val mkey = detail::toMdbVal(key);
+            MDB_val mval {sizeof(VElem)*count, nullptr};
+            LMDBCOLS_IF_METRICS( detail::OpTimer timer; )
+            auto rc = mdb_put(txn, dbi(txn), &mkey, &mval, MDB_RESERVE);
+            if(rc) lmdb::error::raise("DbiWrapper RESERVE error", rc);
+            LMDBCOLS_IF_METRICS( m_metrics->recordPut(mval.mv_size, timer.nanos()); )
+            return LmdbWriteSpan<VElem>{mval};
+        }
+
+        // --- Getting
+    
+        template <typename K>
+        LmdbSpan<unsigned char> get(lmdb::txn &txn, const K &key) {
+            MDB_val mval;
+            // TODO idiomatic cast
+            MDB_val mkey {sizeof(key), (void*)&key};
+            LMDBCOLS_IF_METRICS( detail::OpTimer timer; )
+            int rc = mdb_get(txn, dbi(txn), &mkey, &mval);
+            LMDBCOLS_IF_METRICS( m_metrics->recordGet(rc == 0, rc ? 0 : mval.mv_size, timer.nanos()); )
+            if(rc) lmdb::error::raise("DbiWrapper GET error", rc);
+            return LmdbSpan<unsigned char>{mval};
+        }
+
+        // As get(), but a missing key gives false rather than an exception,
+        // in a single lookup (where exists() then get() would do two)
+        template <typename K>
+        bool tryGet(lmdb::txn &txn, const K &key, MDB_val &out) {
+            MDB_val mkey = detail::toMdbVal(key);
+            LMDBCOLS_IF_METRICS( detail::OpTimer timer; )
+            const int rc = mdb_get(txn, dbi(txn), &mkey, &out);
+            LMDBCOLS_IF_METRICS( m_metrics->recordGet(rc == 0, rc ? 0 : out.mv_size, timer.nanos()); )
+            if(rc == MDB_NOTFOUND) return false;
+            if(rc) lmdb::error::raise("DbiWrapper GET error", rc);
+            return true;
+        }
+
+        // --- Batch getting
+        //
+        // Looks up all n keys through one cursor, visiting them in the DB's key
+        // order (duplicates just once), so neighbouring keys find their leaf
+        // page already there rather than each doing a descent from the root.
+        // out[i] / found[i] are for keys[i]; out[i].mv_data is null if missing.
+        //
+        // With prefetch we also madvise(MADV_WILLNEED) the pages of values too
+        // big to live in their leaf page, so the OS starts reading them in
+        // before the caller gets to them. (No-op where there's no madvise.)
+        //
+        // Returns number of keys found.
+
+        template <typename K>
+        size_t getMany(lmdb::txn &txn, const K *keys, size_t n,
+                       std::vector<MDB_val> &out, std::vector<bool> &found,
+                       bool prefetch = false) {
+            const MDB_dbi myDbi = dbi(txn);
+            out.assign(n, MDB_val{0, nullptr});
+            found.assign(n, false);
+
+            auto keyVal = [keys](size_t i) {return detail::toMdbVal(keys[i]);};
+
+            std::vector<size_t> order (n);
+            for(size_t i = 0; i < n; ++i) order[i] = i;
+            MDB_txn *rawTxn = txn;
+            std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+                    const MDB_val ka = keyVal(a), kb = keyVal(b);
+                    return mdb_cmp(rawTxn, myDbi, &ka, &kb) < 0; });
+
+            auto cursor = lmdb::cursor::open(txn, myDbi);
+            size_t numFound = 0;
+            for(size_t j = 0; j < n; ++j) {
+                const size_t i = order[j];
+                if(j && !memcmp(&keys[i], &keys[order[j-1]], sizeof(K))) {
+                    out[i] = out[order[j-1]]; found[i] = found[order[j-1]];
+                } else {
+                    MDB_val mkey = keyVal(i);
+                    LMDBCOLS_IF_METRICS( detail::OpTimer timer; )
+                    const int rc = mdb_cursor_get(cursor, &mkey, &out[i], MDB_SET_KEY);
+                    LMDBCOLS_IF_METRICS( m_metrics->recordGet(rc == 0, rc ? 0 : out[i].mv_size,
+                                                              timer.nanos()); )
+                    if(rc == MDB_NOTFOUND) {
+                        out[i] = MDB_val{0, nullptr};
+                        continue;
+                    }
+                    if(rc) lmdb::error::raise("DbiWrapper GET MANY error", rc);
+                    found[i] = true;
+                    if(prefetch) detail::adviseWillNeed(out[i], true);
+                }
+                if(found[i]) ++numFound;
+            }
+            return numFound;
+        }
+
+        // --- Deleting
+
+        // Removes key (and all its values, in a DUPSORT DB); false if absent
+        template <typename K>
+        bool del(lmdb::txn &txn, const K &key) {
+            MDB_val mkey = detail::toMdbVal(key);
+            const int rc = mdb_del(txn, dbi(txn), &mkey, nullptr);
+            if(rc == MDB_NOTFOUND) return false;
+            if(rc) lmdb::error::raise("DbiWrapper DEL error", rc);
+            return true;
+        }
+
+        // Removes every key in [lo, hi) (and all their values, in a DUPSORT
+        // DB) in one cursor walk, rather than a lookup per key. Returns the
+        // number of keys removed.
+        template <typename K>
+        size_t delRange(lmdb::txn &txn, const K &lo, const K &hi) {
+            const MDB_dbi handle = dbi(txn);
+            unsigned int dbFlags;
+            int rc = mdb_dbi_flags(txn, handle, &dbFlags);
+            if(rc) lmdb::error::raise("DbiWrapper DEL RANGE flags", rc);
+            const unsigned int delFlags = (dbFlags & MDB_DUPSORT) ? MDB_NODUPDATA : 0;
+
+            auto cursor = lmdb::cursor::open(txn, handle);
+            MDB_val mkey = detail::toMdbVal(lo);
+            MDB_val mhi  = detail::toMdbVal(hi);
+            MDB_val mval;
+            size_t res = 0;
+            // After a delete the cursor already sits on the next key, which
+            // MDB_NEXT knows not to skip
+            for(rc = mdb_cursor_get(cursor, &mkey, &mval, MDB_SET_RANGE); ! rc;
+                rc = mdb_cursor_get(cursor, &mkey, &mval, MDB_NEXT_NODUP)) {
+                if(mdb_cmp(txn, handle, &mkey, &mhi) >= 0) return res;
+                rc = mdb_cursor_del(cursor, delFlags);
+                if(rc) lmdb::error::raise("DbiWrapper DEL RANGE error", rc);
+                ++res;
+            }
+            if(rc != MDB_NOTFOUND) lmdb::error::raise("DbiWrapper DEL RANGE seek", rc);
+            return res;
+        }
+
+        // Empties the DB, keeping it (and its handle) for reuse
+        void clear(lmdb::txn &txn) {
+            const int rc = mdb_drop(txn, dbi(txn), 0);
+            if(rc) lmdb::error::raise("DbiWrapper CLEAR error", rc);
+        }
+
+        // --- Updating in place
+
+        // Runs fn(V &) on a copy of key's value and writes it back over the
+        // old one (MDB_CURRENT, same size, so no delete and re-insert).
+        // False, without calling fn, if key is missing. Not for DUPSORT DBs.
+        // NB even under writeMap we don't write through the pointer get()
+        // gives: that page may still be shared with readers' snapshots, and
+        // the cursor put is what makes LMDB copy it first.
+        template <typename K, typename V, typename Fn>
+        bool update(lmdb::txn &txn, const K &key, Fn fn) {
+            auto cursor = lmdb::cursor::open(txn, dbi(txn));
+            MDB_val mkey = detail::toMdbVal(key);
+            MDB_val mval;
+            int rc = mdb_cursor_get(cursor, &mkey, &mval, MDB_SET_KEY);
+            if(rc == MDB_NOTFOUND) return false;
+            if(rc) lmdb::error::raise("DbiWrapper UPDATE seek", rc);
+            if(mval.mv_size != sizeof(V)) lmdb::error::raise("DbiWrapper UPDATE size mismatch", MDB_BAD_VALSIZE);
+
+            V val;
+            memcpy(&val, mval.mv_data, sizeof(V));
+            fn(val);
+            MDB_val mnew = detail::toMdbVal(val);
+            LMDBCOLS_IF_METRICS( detail::OpTimer timer; )
+            rc = mdb_cursor_put(cursor, &mkey, &mnew, MDB_CURRENT);
+            if(rc) lmdb::error::raise("DbiWrapper UPDATE error", rc);
+            LMDBCOLS_IF_METRICS( m_metrics->recordPut(mnew.mv_size, timer.nanos()); )
+            return true;
+        }
+
+        // --- Key presence checking
+        template <typename K>
+        bool exists(lmdb::txn &txn, const K &key) {
+            // TODO idiomatic cast
+            MDB_val mkey {sizeof(key), (void*)&key};
+            MDB_val mval;
+            LMDBCOLS_IF_METRICS( detail::OpTimer timer; )
+            int rc = mdb_get(txn, dbi(txn), &mkey, &mval);
+            LMDBCOLS_IF_METRICS( m_metrics->recordGet(rc == 0, rc ? 0 : mval.mv_size, timer.nanos()); )
+            if(rc == MDB_NOTFOUND) return false;
+            else if(rc == 0)       return true;
+            else lmdb::error::raise("DbiWrapper EXISTS error", rc);
+        }
+    };
+    
+    
+    // ======================================================================
+    // == CursorRange ===
+    // ==
+    // ==   Zero-copy, in-order iteration over all or part of a collection,
+    // ==   built on an MDB_cursor. You get these from the scan*() methods on
+    // ==   the MapDB classes, and mostly just use them in range-for loops:
+    // ==
+    // ==       for(auto kv : pathsDB.scanRange(txn, 100, 200))
+    // ==           doStuff(kv.first, kv.second);
+    // ==
+    // ==   kv.first is a const TAllKey&, and kv.second is whatever the
+    // ==   collection's get() returns (const TAllVal& or LmdbSpan<TAllValElem>).
+    // ==   Both point straight into the map, so are only valid while the txn
+    // ==   is, and come with the same alignment guarantees as get().
+    // ==
+    // ==   Bounds are compared with the DB's own key comparison (mdb_cmp), so
+    // ==   ranges follow whatever order LMDB stores the keys in.
+    // ==
+    // ==   NB the iterators all share the range's one cursor, so they're single
+    // ==   pass (input iterators): advancing one advances them all.
+    // ==   Don't write to the DB through the same txn while iterating.
+    // ======================================================================
+
+    enum class ScanOrder { Forward, Reverse };
+
+    namespace detail {
+        // How each collection turns a raw MDB_val into what its get() returns
+        template <typename TAllVal>
+        struct PodValAdapt {
+            using type = const TAllVal &;
+            static const TAllVal &from(const MDB_val &mv) {
+                return LmdbSpan<unsigned char>{mv}.asType<TAllVal>();
+            }
+        };
+
+        template <typename TAllValElem>
+        struct PodArrayValAdapt {
+            using type = LmdbSpan<TAllValElem>;
+            static LmdbSpan<TAllValElem> from(const MDB_val &mv) {
+                return LmdbSpan<unsigned char>{mv}.asSpan<TAllValElem>();
+            }
+        };
+
+        // Packed arrays: a uint64_t element count, then the elements, densely
+        // (see MapDB_Pod_PackedArray)
+        template <typename TAllValElem>
+        struct PackedArrayValAdapt {
+            using type = LmdbSpan<TAllValElem>;
+            static LmdbSpan<TAllValElem> from(const MDB_val &mv) {
+                assert( mv.mv_size >= sizeof(uint64_t) );
+                const auto count = static_cast<size_t>(LmdbSpan<uint64_t>{mv}[0]);
+                assert( sizeof(uint64_t) + count * sizeof(TAllValElem) <= mv.mv_size );
+                const unsigned char *elems = static_cast<const unsigned char *>(mv.mv_data) + sizeof(uint64_t);
+                return LmdbSpan<TAllValElem>{reinterpret_cast<const TAllValElem *>(elems), count};
+            }
+        };
+
+        // The stored bytes, untouched, for collections that decode them themselves
+        struct RawValAdapt {
+            using type = MDB_val;
+            static MDB_val from(const MDB_val &mv) {return mv;}
+        };
+
+        // One end of a scan: a copy of the bytes of (the start of) a key
+        template <size_t MaxBytes>
+        struct KeyBound {
+            unsigned char bytes[MaxBytes];
+            size_t size = 0;
+            bool   isSet = false;
+
+            static KeyBound none() {return KeyBound{};}
+
+            static KeyBound of(const void *data, size_t len) {
+                assert( len <= MaxBytes );
+                KeyBound res;
+                memcpy(res.bytes, data, len);
+                res.size = len; res.isSet = true;
+                return res;
+            }
+
+            // Smallest byte string greater than everything starting with
+            // these bytes (under memcmp ordering), or none() if there isn't one
+            KeyBound prefixSuccessor() const {
+                KeyBound res = *this;
+                while(res.size && res.bytes[res.size-1] == 0xFF) --res.size;
+                if(! res.size) return none();
+                ++res.bytes[res.size-1];
+                return res;
+            }
+
+            MDB_val val() const {return toMdbVal(bytes, size);}
+        };
+    }  // namespace detail
+
+    template <typename TAllKey, typename TValAdapt>
+    class CursorRange {
+    public:
+        using Bound      = detail::KeyBound<sizeof(TAllKey)>;
+        using key_type   = TAllKey;
+        using value_type = std::pair<const TAllKey &, typename TValAdapt::type>;
+
+        class iterator {
+            CursorRange *m_range;  // nullptr once we hit the end
+
+        public:
+            using iterator_category = std::input_iterator_tag;
+            using value_type        = CursorRange::value_type;
+            using difference_type   = std::ptrdiff_t;
+            using pointer           = void;
+            using reference         = CursorRange::value_type;
+
+            explicit iterator(CursorRange *range) :m_range{range} {}
+
+            value_type operator*() const {
+                assert( m_range );
+                return value_type{ LmdbSpan<unsigned char>{m_range->m_key}.asType<TAllKey>(),
+                                   TValAdapt::from(m_range->m_val) };
+            }
+
+            iterator &operator++() {
+                assert( m_range );
+                if(! m_range->step(m_range->m_reverse ? MDB_PREV : MDB_NEXT))
+                    m_range = nullptr;
+                return *this;
+            }
+
+            bool operator==(const iterator &o) const {return m_range == o.m_range;}
+            bool operator!=(const iterator &o) const {return m_range != o.m_range;}
+        };
+
+        explicit CursorRange(lmdb::txn &txn, MDB_dbi dbi,
+                             const Bound &lo, const Bound &hi, ScanOrder order)
+            :m_txn{txn}, m_dbi{dbi}, m_cursor{lmdb::cursor::open(txn, dbi)},
+             m_lo(lo), m_hi(hi), m_reverse{order == ScanOrder::Reverse} {}
+
+        // --- The usual ranges, as the MapDB classes offer them
+
+        static CursorRange all(lmdb::txn &txn, MDB_dbi dbi, ScanOrder order) {
+            return CursorRange{txn, dbi, Bound::none(), Bound::none(), order};
+        }
+
+        // Keys in [lo, hi)
+        static CursorRange between(lmdb::txn &txn, MDB_dbi dbi,
+                                   const TAllKey &lo, const TAllKey &hi, ScanOrder order) {
+            return CursorRange{txn, dbi, Bound::of(&lo, sizeof(lo)), Bound::of(&hi, sizeof(hi)), order};
+        }
+
+        // Keys >= lo (a lower-bound seek)
+        static CursorRange from(lmdb::txn &txn, MDB_dbi dbi, const TAllKey &lo, ScanOrder order) {
+            return CursorRange{txn, dbi, Bound::of(&lo, sizeof(lo)), Bound::none(), order};
+        }
+
+        // Keys whose leading sizeof(TPrefix) bytes match prefix's, e.g. all
+        // keys sharing a struct key's first member.
+        // Only meaningful for DBs using the default (memcmp) key order.
+        template <typename TPrefix>
+        static CursorRange withPrefix(lmdb::txn &txn, MDB_dbi dbi,
+                                      const TPrefix &prefix, ScanOrder order) {
+            static_assert(sizeof(TPrefix) <= sizeof(TAllKey), "Prefix longer than key");
+            const auto lo = Bound::of(&prefix, sizeof(prefix));
+            return CursorRange{txn, dbi, lo, lo.prefixSuccessor(), order};
+        }
+
+        // (Re)positions the cursor at the start of the range
+        iterator begin() {
+            return iterator{ seekStart() ? this : nullptr };
+        }
+        iterator end() {return iterator{nullptr};}
+
+    private:
+        MDB_txn *m_txn;
+        MDB_dbi  m_dbi;
+        lmdb::cursor m_cursor;
+        Bound m_lo, m_hi;  // [lo, hi)
+        bool  m_reverse;
+
+        MDB_val m_key, m_val;  // Current record
+
+        bool cursorGet(MDB_cursor_op op) {
+            const int rc = mdb_cursor_get(m_cursor, &m_key, &m_val, op);
+            if(rc == MDB_NOTFOUND) return false;
+            if(rc) lmdb::error::raise("CursorRange cursor get", rc);
+            return true;
+        }
+
+        // Position at the first key >= bound (SET_RANGE writes the found key
+        // back into m_key, so the bound itself is left alone)
+        bool cursorSeek(const Bound &bound) {
+            m_key = bound.val();
+            return cursorGet(MDB_SET_RANGE);
+        }
+
+        bool inRange() const {
+            if(m_reverse) {
+                if(! m_lo.isSet) return true;
+                const MDB_val lo = m_lo.val();
+                return mdb_cmp(m_txn, m_dbi, &m_key, &lo) >= 0;
+            }
+            if(! m_hi.isSet) return true;
+            const MDB_val hi = m_hi.val();
+            return mdb_cmp(m_txn, m_dbi, &m_key, &hi) < 0;
+        }
+
+        bool seekStart() {
+            bool found;
+            if(! m_reverse)
+                found = m_lo.isSet ? cursorSeek(m_lo) : cursorGet(MDB_FIRST);
+            else if(! m_hi.isSet)
+                found = cursorGet(MDB_LAST);
+            else
+                // Last key < hi: step back from the first key >= hi, or from
+                // the very end if there's no such key
+                found = cursorSeek(m_hi) ? cursorGet(MDB_PREV) : cursorGet(MDB_LAST);
+            return found && inRange();
+        }
+
+        bool step(MDB_cursor_op op) {
+            return cursorGet(op) && inRange();
+        }
+    };
+
+
+    // ======================================================================
+    // == BulkLoader ===
+    // ==
+    // ==   Fast path for filling a DB from input that's already sorted by key,
+    // ==   e.g. when rebuilding a DB from scratch.
+    // ==
+    // ==   Everything goes in through one cursor with MDB_APPEND (MDB_APPENDDUP
+    // ==   for further values of the last key in DUPSORT DBs), so LMDB skips
+    // ==   the B-tree descent on each put and fills pages completely rather
+    // ==   than splitting them half full.
+    // ==
+    // ==   We check that keys (and a DUPSORT key's values) arrive in ascending
+    // ==   order, throwing std::invalid_argument where LMDB would give a less
+    // ==   helpful MDB_KEYEXIST, and commit every so many records or
+    // ==   bytes to keep the dirty page memory of the write txn bounded.
+    // ==   NB this means a failed load can leave earlier batches committed.
+    // ==
+    // ==   Holds a write txn for its whole life, so don't open another on the
+    // ==   same thread until you've called finish() (or destroyed it, which
+    // ==   aborts the current batch, same as lmdb::txn).
+    // ==
+    // ==   You get these from bulkLoader() on the MapDB classes.
+    // ======================================================================
+
+    struct BulkLoadOptions {
+        size_t commitEveryRecords = 100000;
+        size_t commitEveryBytes   = 256UL * 1024UL * 1024UL;
+    };
+
+    struct BulkLoadStats {
+        size_t records = 0;
+        size_t bytes   = 0;  // Of keys and values
+        size_t commits = 0;
+        double seconds = 0;  // Wall time from loader creation to finish()
+
+        double recordsPerSec() const {return seconds > 0 ? records / seconds : 0;}
+        double bytesPerSec()   const {return seconds > 0 ? bytes / seconds : 0;}
+    };
+
+    template <typename TAllKey, typename TAllValElem>
+    class BulkLoader {
+        DatabaseEnvironment &m_env;
+        DbiWrapper &m_dbiWrap;
+        const BulkLoadOptions m_opts;
+
+        MDB_dbi      m_dbi = 0;  // Re-resolved for each txn (see DbiWrapper)
+        lmdb::txn    m_txn;
+        lmdb::cursor m_cursor;
+        bool         m_dupSort;
+
+        TAllKey m_lastKey;
+        bool    m_haveLastKey = false;
+        std::vector<char> m_lastVal;  // Only kept for DUPSORT DBs
+
+        size_t m_recordsInTxn = 0, m_bytesInTxn = 0;
+        BulkLoadStats m_stats;
+        const std::chrono::steady_clock::time_point m_start = std::chrono::steady_clock::now();
+
+        lmdb::cursor openCursor() {
+            m_dbi = m_dbiWrap.handle(m_txn);
+            return lmdb::cursor::open(m_txn, m_dbi);
+        }
+
+        bool isDupSort() {
+            unsigned int dbFlags;
+            const int rc = mdb_dbi_flags(m_txn, m_dbi, &dbFlags);
+            if(rc) lmdb::error::raise("BulkLoader dbi flags", rc);
+            return dbFlags & MDB_DUPSORT;
+        }
+
+        void throwUnordered(const char *what) {
+            throw std::invalid_argument{string{"BulkLoader: "} + what + " not in ascending order, for DB "
+                                        + m_dbiWrap.name()};
+        }
+
+        void commitBatch() {
+            m_cursor.close();
+            m_txn.commit();
+            ++m_stats.commits;
+            m_recordsInTxn = m_bytesInTxn = 0;
+        }
+        
+    public:
+        explicit BulkLoader(DatabaseEnvironment &env, DbiWrapper &dbiWrap,
+                            const BulkLoadOptions &opts = BulkLoadOptions{})
+            :m_env{env}, m_dbiWrap{dbiWrap}, m_opts(opts),
+             m_txn{env.openWriteTxn()}, m_cursor{openCursor()}, m_dupSort{isDupSort()} {}
+
+        void add(const TAllKey &key, const TAllValElem *dat, size_t count) {
+            addRaw(detail::toMdbVal(key), detail::toMdbVal(dat, count));
+        }
+
+        void add(const TAllKey &key, const TAllValElem &val) {add(key, &val, 1);}
+
+        // Key and value as raw bytes, e.g. records read back by loadFlat().
+        // The key must be a TAllKey's worth; the value isn't checked.
+        void addRaw(MDB_val mkey, MDB_val mval) {
+            if(mkey.mv_size != sizeof(TAllKey))
+                throw std::invalid_argument{"BulkLoader: wrong key size, for DB " + m_dbiWrap.name()};
+
+            // A new key goes on the end of the DB (MDB_APPEND); another value
+            // for the last key, in a DUPSORT DB, on the end of its set
+            // (MDB_APPENDDUP). Not both: MDB_APPEND refuses an equal key.
+            unsigned int putFlags = MDB_APPEND;
+            if(m_haveLastKey) {
+                MDB_val mlast = detail::toMdbVal(m_lastKey);
+                const int cmp = mdb_cmp(m_txn, m_dbi, &mkey, &mlast);
+                if(cmp < 0 || (cmp == 0 && ! m_dupSort)) throwUnordered("keys");
+                if(cmp == 0) {
+                    MDB_val mlastVal {m_lastVal.size(), m_lastVal.data()};
+                    if(mdb_dcmp(m_txn, m_dbi, &mval, &mlastVal) <= 0) throwUnordered("values of a key");
+                    putFlags = MDB_APPENDDUP;
+                }
+            }
+
+            const int rc = mdb_cursor_put(m_cursor, &mkey, &mval, putFlags);
+            if(rc) lmdb::error::raise("BulkLoader cursor put", rc);
+
+            memcpy(&m_lastKey, mkey.mv_data, sizeof(TAllKey)); m_haveLastKey = true;
+            if(m_dupSort) {
+                const char *valBytes = static_cast<const char *>(mval.mv_data);
+                m_lastVal.assign(valBytes, valBytes + mval.mv_size);
+            }
+            ++m_recordsInTxn; ++m_stats.records;
+            m_bytesInTxn += mkey.mv_size + mval.mv_size;
+            m_stats.bytes += mkey.mv_size + mval.mv_size;
+
+            if(m_recordsInTxn >= m_opts.commitEveryRecords || m_bytesInTxn >= m_opts.commitEveryBytes) {
+                commitBatch();
+                m_txn = m_env.openWriteTxn();
+                m_cursor = openCursor();
+            }
+        }
+
+        // Commits whatever's outstanding; don't add() after this
+        const BulkLoadStats &finish() {
+            commitBatch();
+            m_stats.seconds = std::chrono::duration<double>(
+                                  std::chrono::steady_clock::now() - m_start).count();
+            return m_stats;
+        }
+
+        const BulkLoadStats &stats() const {return m_stats;}
+    };
+
+
+    // ======================================================================
+    // == dumpFlat / loadFlat ===
+    // ==
+    // ==   Streams one collection out to a flat binary file and back in,
+    // ==   e.g. to move a single DB between envs or hosts. (For the whole
+    // ==   env, DatabaseEnvironment::snapshotTo() is simpler and faster.)
+    // ==
+    // ==   Records are written in the DB's key order, so loading goes
+    // ==   through a BulkLoader and gets the MDB_APPEND fast path. The
+    // ==   target must use the same key order (i.e. the same collection type
+    // ==   and DB flags) as the source.
+    // ==
+    // ==   Format, all in native byte order and 8 byte words, so a mmap of
+    // ==   the file can be walked with each key and value suitably aligned:
+    // ==
+    // ==     header:  magic "LMCFLAT1", version, key size, source DB flags
+    // ==     record:  key bytes, value bytes, key, value (each padded to 8)
+    // ==     trailer: ~0, record count
+    // ==
+    // ==   Works with collections offering handle() and bulkLoader():
+    // ==   MapDB_Pod_Pod, MapDB_Pod_PodArray and MapDB_Pod_MultiPod (each
+    // ==   duplicate of a key in a MultiPod is its own record).
+    // ======================================================================
+
+    struct FlatDumpStats {
+        size_t records = 0;
+        size_t bytes   = 0;  // Written or read, including framing
+        double seconds = 0;
+
+        double recordsPerSec() const {return seconds > 0 ? records / seconds : 0;}
+        double bytesPerSec()   const {return seconds > 0 ? bytes / seconds : 0;}
+    };
+
+    namespace detail {
+        static constexpr uint64_t flatMagic   = 0x3154414c46434d4cULL;  // "LMCFLAT1" little-endian
+        static constexpr uint64_t flatVersion = 1;
+        static constexpr uint64_t flatEnd     = ~uint64_t(0);
+
+        inline size_t paddedTo8(size_t bytes) {return (bytes + 7) & ~size_t(7);}
+
+        inline void writeWord(std::ostream &out, uint64_t word) {
+            out.write(reinterpret_cast<const char *>(&word), sizeof(word));
+        }
+
+        inline void writePadded(std::ostream &out, const MDB_val &mv) {
+            static const char zeros[8] = {};
+            out.write(static_cast<const char *>(mv.mv_data), mv.mv_size);
+            out.write(zeros, paddedTo8(mv.mv_size) - mv.mv_size);
+        }
+
+        inline uint64_t readWord(std::istream &in) {
+            uint64_t word;
+            if(! in.read(reinterpret_cast<char *>(&word), sizeof(word)))
+                throw std::runtime_error("loadFlat: input truncated");
+            return word;
+        }
+    }
+
+    // Writes every record in db, as of txn's snapshot, to out
+    template <typename TDb>
+    FlatDumpStats dumpFlat(lmdb::txn &txn, TDb &db, std::ostream &out) {
+        const auto start = std::chrono::steady_clock::now();
+        const MDB_dbi dbi = db.handle(txn);
+        unsigned int dbFlags;
+        const int rc = mdb_dbi_flags(txn, dbi, &dbFlags);
+        if(rc) lmdb::error::raise("dumpFlat dbi flags", rc);
+
+        FlatDumpStats res;
+        detail::writeWord(out, detail::flatMagic);
+        detail::writeWord(out, detail::flatVersion);
+        detail::writeWord(out, sizeof(typename TDb::key_type));
+        detail::writeWord(out, dbFlags);
+
+        auto cursor = lmdb::cursor::open(txn, dbi);
+        MDB_val mkey, mval;
+        for(bool more = cursor.get(&mkey, &mval, MDB_FIRST); more;
+            more = cursor.get(&mkey, &mval, MDB_NEXT)) {
+            detail::writeWord(out, mkey.mv_size);
+            detail::writeWord(out, mval.mv_size);
+            detail::writePadded(out, mkey);
+            detail::writePadded(out, mval);
+            ++res.records;
+            res.bytes += 2 * sizeof(uint64_t) + detail::paddedTo8(mkey.mv_size)
+                                              + detail::paddedTo8(mval.mv_size);
+        }
+        detail::writeWord(out, detail::flatEnd);
+        detail::writeWord(out, res.records);
+        res.bytes += 6 * sizeof(uint64_t);
+        if(! out) throw std::runtime_error("dumpFlat: write failed");
+
+        res.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return res;
+    }
+
+    // Adds the records from a dumpFlat() stream to db, in txns of its own
+    // (see BulkLoader). db should be empty, or hold only keys before the
+    // dump's first. Throws std::runtime_error on a malformed or cut-off
+    // stream, by which time earlier batches may have been committed.
+    template <typename TDb>
+    FlatDumpStats loadFlat(DatabaseEnvironment &env, TDb &db, std::istream &in,
+                           const BulkLoadOptions &opts = BulkLoadOptions{}) {
+        const auto start = std::chrono::steady_clock::now();
+        if(detail::readWord(in) != detail::flatMagic)
+            throw std::runtime_error("loadFlat: not a flat dump");
+        if(detail::readWord(in) != detail::flatVersion)
+            throw std::runtime_error("loadFlat: unknown flat dump version");
+        if(detail::readWord(in) != sizeof(typename TDb::key_type))
+            throw std::runtime_error("loadFlat: key size differs from target collection's");
+        detail::readWord(in);  // Source DB flags, for information
+
+        FlatDumpStats res;
+        res.bytes = 4 * sizeof(uint64_t);
+        auto loader = db.bulkLoader(env, opts);
+        std::vector<uint64_t> buf;  // Words, so key and value stay aligned
+        for(;;) {
+            const uint64_t keyBytes = detail::readWord(in);
+            const uint64_t valBytes = detail::readWord(in);  // Record count, in the trailer
+            res.bytes += 2 * sizeof(uint64_t);
+            if(keyBytes == detail::flatEnd) {
+                if(valBytes != res.records) throw std::runtime_error("loadFlat: record count mismatch");
+                break;
+            }
+            const size_t keyPadded = detail::paddedTo8(keyBytes);
+            const size_t total = keyPadded + detail::paddedTo8(valBytes);
+            buf.resize(total / sizeof(uint64_t));
+            char *bytes = reinterpret_cast<char *>(buf.data());
+            if(! in.read(bytes, total))
+                throw std::runtime_error("loadFlat: input truncated");
+            loader.addRaw(MDB_val {keyBytes, bytes}, MDB_val {valBytes, bytes + keyPadded});
+            ++res.records;
+            res.bytes += total;
+        }
+        loader.finish();
+
+        res.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return res;
+    }
+
+
+    // ======================================================================
+    // == MapDB_PodPod ===
+    // ==
+    // ==   Manager for a single named LMDB database (within a db file) that
+    // ==   has all keys of the POD type TAllKey, and all values of type TAllVal.
+    // ==   (The 'All' bit refers to alignment; see below.)
+    // ==
+    // ==   Gives you simple get/put access to the contents, plus in-order
+    // ==   scans over all or part of it (see CursorRange).
+    // ==
+    // ==   You are required to provide TAllKey and TAllVal with sizeof % 8,
+    // ==   to preserve alignment inside the database.
+    // ==
+    // ==   See the EightPadded type if you want an easy way of making a suitable
+    // ==   type from yours, or MapDB_AutoPadded_Pod_Pod if you want the
+    // ==   EightPadded wrapping to be applied automatically.
+    // ======================================================================
+
+    template <typename TAllKey, typename TAllVal>
+    class MapDB_Pod_Pod {
+        static_assert(is_valid_keyval_type<TAllKey>::value, "");
+        static_assert(is_valid_keyval_type<TAllVal>::value, "");
+        
+        DbiWrapper m_dbiWrap;
+    
+    public:
+        using key_type = TAllKey;
+
+        // Flags used when you don't give any (see key_dbiflags)
+        static constexpr unsigned int defaultDbiFlags =
+            DbiWrapper::default_dbiflags | key_dbiflags<TAllKey>::value;
+
+        explicit MapDB_Pod_Pod(const string &dbName) :m_dbiWrap{dbName, defaultDbiFlags} {}
+        explicit MapDB_Pod_Pod(const string &dbName, const unsigned int dbiFlags)
+            :m_dbiWrap{dbName, dbiFlags} {}
+
+        // Resolves the DB handle once, up front; prefer these on hot paths
+        explicit MapDB_Pod_Pod(DatabaseEnvironment &env, const string &dbName)
+            :m_dbiWrap{env, dbName, defaultDbiFlags} {}
+        explicit MapDB_Pod_Pod(DatabaseEnvironment &env, const string &dbName,
+                               const unsigned int dbiFlags)
+            :m_dbiWrap{env, dbName, dbiFlags} {}
+        
+        void put(lmdb::txn &txn, const TAllKey &key, const TAllVal &val) {
+            m_dbiWrap.put(txn, key, val);
+        }
+        
+        const TAllVal &get(lmdb::txn &txn, const TAllKey &key) {
+            LmdbSpan<unsigned char> sp = m_dbiWrap.get(txn, key);
+            return sp.asType<TAllVal>();
+        }
+
+        bool exists(lmdb::txn &txn, const TAllKey &key) {
+            return m_dbiWrap.exists(txn, key);
+        }
+
+        // --- Removing and updating
+
+        // False if key wasn't there
+        bool erase(lmdb::txn &txn, const TAllKey &key) {return m_dbiWrap.del(txn, key);}
+
+        // Removes keys in [lo, hi) in one cursor walk; returns how many
+        size_t eraseRange(lmdb::txn &txn, const TAllKey &lo, const TAllKey &hi) {
+            return m_dbiWrap.delRange(txn, lo, hi);
+        }
+
+        // Calls fn(TAllVal &) to modify key's value in place; false if missing
+        template <typename Fn>
+        bool update(lmdb::txn &txn, const TAllKey &key, Fn fn) {
+            return m_dbiWrap.update<TAllKey, TAllVal>(txn, key, fn);
+        }
+
+        // Removes everything (mdb_drop), much faster than erasing key by key
+        void clear(lmdb::txn &txn) {m_dbiWrap.clear(txn);}
+
+        // The underlying DB handle, for raw LMDB calls (cursors, mdb_cmp...)
+        MDB_dbi handle(lmdb::txn &txn) {return m_dbiWrap.handle(txn);}
+
+        // Looks up a batch of keys in one go; much quicker than get() in a loop
+        // for big batches (see DbiWrapper::getMany).
+        // out[i] points at the value for keys[i], or is nullptr if it's missing,
+        // in which case found[i] is also false. Returns number found.
+        size_t getMany(lmdb::txn &txn, const std::vector<TAllKey> &keys,
+                       std::vector<const TAllVal *> &out, std::vector<bool> &found,
+                       bool prefetch = false) {
+            std::vector<MDB_val> vals;
+            const size_t res = m_dbiWrap.getMany(txn, keys.data(), keys.size(), vals, found, prefetch);
+            out.resize(keys.size());
+            for(size_t i = 0; i < keys.size(); ++i)
+                out[i] = found[i] ? &detail::PodValAdapt<TAllVal>::from(vals[i]) : nullptr;
+            return res;
+        }
+
+        // Fast loading of key-sorted input (see BulkLoader)
+        BulkLoader<TAllKey, TAllVal>
+        bulkLoader(DatabaseEnvironment &env, const BulkLoadOptions &opts = BulkLoadOptions{}) {
+            return BulkLoader<TAllKey, TAllVal>{env, m_dbiWrap, opts};
+        }
+
+        // --- Iteration (see CursorRange)
+
+        using Range = CursorRange<TAllKey, detail::PodValAdapt<TAllVal>>;
+
+        Range scan(lmdb::txn &txn, ScanOrder order = ScanOrder::Forward) {
+            return Range::all(txn, m_dbiWrap.handle(txn), order);
+        }
+
+        // Keys in [lo, hi)
+        Range scanRange(lmdb::txn &txn, const TAllKey &lo, const TAllKey &hi,
+                        ScanOrder order = ScanOrder::Forward) {
+            return Range::between(txn, m_dbiWrap.handle(txn), lo, hi, order);
+        }
+
+        // Keys >= lo
+        Range scanFrom(lmdb::txn &txn, const TAllKey &lo, ScanOrder order = ScanOrder::Forward) {
+            return Range::from(txn, m_dbiWrap.handle(txn), lo, order);
+        }
+
+        template <typename TPrefix>
+        Range scanPrefix(lmdb::txn &txn, const TPrefix &prefix,
+                         ScanOrder order = ScanOrder::Forward) {
+            return Range::withPrefix(txn, m_dbiWrap.handle(txn), prefix, order);
+        }
+    };
+
+
+    // ======================================================================
+    // == MapDB_AutoPadded_Pod_Pod ===
+    // ==
+    // ==   Exactly the same as MapDB_Pod_Pod, but wraps your key and value
+    // ==   types in an implicit EightPadded, which gets used behind the scenes
+    // ==   when you call get() and put();
+    // ==
+    // ==   We give this a slightly longer name than MapDB_Pod_Pod because you
+    // ==   probably want to think about whether the extra padding will have an
+    // ==   effect on your space usage and performance.
+    // ==   For small/simple uses it really won't.
+    // ======================================================================
+    
+    template <typename TKey, typename TVal>
+    class MapDB_AutoPadded_Pod_Pod {
+        using PadKey = EightPadded<TKey>;
+        using PadVal = EightPadded<TVal>;
+        
+        MapDB_Pod_Pod<PadKey, PadVal> m_db;
+    
+    public:
+        explicit MapDB_AutoPadded_Pod_Pod(const string &dbName) :m_db{dbName} {}
+        explicit MapDB_AutoPadded_Pod_Pod(const string &dbName, const unsigned int dbiFlags)
+            :m_db{dbName, dbiFlags} {}
+
+        // Resolves the DB handle once, up front; prefer these on hot paths
+        explicit MapDB_AutoPadded_Pod_Pod(DatabaseEnvironment &env, const string &dbName)
+            :m_db{env, dbName} {}
+        explicit MapDB_AutoPadded_Pod_Pod(DatabaseEnvironment &env, const string &dbName,
+                                          const unsigned int dbiFlags)
+            :m_db{env, dbName, dbiFlags} {}
+        
+        void put(lmdb::txn &txn, const TKey &key, const TVal &val) {
+            m_db.put(txn, PadKey{key}, PadVal{val});
+        }
+        
+        const TVal &get(lmdb::txn &txn, const TKey &key) {
+            const PadVal &pv = m_db.get(txn, PadKey{key});
+            return *pv;
+        }
+
+        bool exists(lmdb::txn &txn, const TKey &key) {
+            return m_db.exists(txn, PadKey{key});
+        }
+
+        bool erase(lmdb::txn &txn, const TKey &key) {return m_db.erase(txn, PadKey{key});}
+
+        size_t eraseRange(lmdb::txn &txn, const TKey &lo, const TKey &hi) {
+            return m_db.eraseRange(txn, PadKey{lo}, PadKey{hi});
+        }
+
+        // Calls fn(TVal &) to modify key's value in place; false if missing
+        template <typename Fn>
+        bool update(lmdb::txn &txn, const TKey &key, Fn fn) {
+            return m_db.update(txn, PadKey{key}, [&fn](PadVal &pv) {fn(pv.get());});
+        }
+
+        void clear(lmdb::txn &txn) {m_db.clear(txn);}
+    };
+
+
+    // ======================================================================
+    // == MapDB_Pod_PodArray ===
+    // ==
+    // ==   Similar to MapDB_Pod_Pod, but stores an array of values
+    // ==   rather than a single one (TAllValElem is value element type).
+    // ==
+    // ==   Similarly, for aligment reasons we require that sizeof(TAllKey) and
+    // ==   sizeof(TAllValElem) are both multiples of 8.
+    // ==
+    // ==   get() returns an LmdbSpan, which is just a normal span/view type,
+    // ==   and very easy to use.
+    // ======================================================================
+    
+    template <typename TAllKey, typename TAllValElem>
+    class MapDB_Pod_PodArray {
+        static_assert(is_valid_keyval_type<TAllKey>::value, "");
+        static_assert(is_valid_keyval_type<TAllValElem>::value, "");
+        
+        DbiWrapper m_dbiWrap;
+
+    public:
+        using key_type = TAllKey;
+
+        // Flags used when you don't give any (see key_dbiflags)
+        static constexpr unsigned int defaultDbiFlags =
+            DbiWrapper::default_dbiflags | key_dbiflags<TAllKey>::value;
+
+        explicit MapDB_Pod_PodArray(const string &dbName) :m_dbiWrap{dbName, defaultDbiFlags} {}
+        explicit MapDB_Pod_PodArray(const string &dbName, const unsigned int dbiFlags)
+            :m_dbiWrap{dbName, dbiFlags} {}
+
+        // Resolves the DB handle once, up front; prefer these on hot paths
+        explicit MapDB_Pod_PodArray(DatabaseEnvironment &env, const string &dbName)
+            :m_dbiWrap{env, dbName, defaultDbiFlags} {}
+        explicit MapDB_Pod_PodArray(DatabaseEnvironment &env, const string &dbName,
+                                    const unsigned int dbiFlags)
+            :m_dbiWrap{env, dbName, dbiFlags} {}
+        
+        // // TODO consider whether I want this one
+        // template <class Range>
+        // void put(lmdb::txn &txn, const TAllKey &key, Range range) {
+        //   static_assert( std::is_same<
+        //                      std::remove_cv_t<TAllValElem>,
+        //                      std::remove_cv_t<typename Range::value_type> >::value,
+        //                  "Calling array put function with range containing wrong value_type" );
+        //   m_dbiWrap.putArray(txn, key, &range[0], range.size()); }
+        
+        LmdbSpan<TAllValElem>
+        get(lmdb::txn &txn, const TAllKey &key) {
+            LmdbSpan<unsigned char> sp = m_dbiWrap.get(txn, key);
+            return sp.asSpan<TAllValElem>();
+        }
+        
+        void put(lmdb::txn &txn, const TAllKey &key, const TAllValElem *data, size_t count) {
+            m_dbiWrap.putArray(txn, key, data, count);
+        }
+
+        // Zero-copy put: makes space for count elements in the DB and returns
+        // it for you to write the value straight into (see LmdbWriteSpan)
+        LmdbWriteSpan<TAllValElem>
+        reserve(lmdb::txn &txn, const TAllKey &key, size_t count) {
+            return m_dbiWrap.reserveArray<TAllKey, TAllValElem>(txn, key, count);
+        }
+        
+        bool exists( lmdb::txn &txn, const TAllKey &key ) {
+            return m_dbiWrap.exists(txn, key);
+        }
+
+        // --- Removing
+
+        // False if key wasn't there
+        bool erase(lmdb::txn &txn, const TAllKey &key) {return m_dbiWrap.del(txn, key);}
+
+        // Removes keys in [lo, hi) in one cursor walk; returns how many
+        size_t eraseRange(lmdb::txn &txn, const TAllKey &lo, const TAllKey &hi) {
+            return m_dbiWrap.delRange(txn, lo, hi);
+        }
+
+        // Removes everything (mdb_drop), much faster than erasing key by key
+        void clear(lmdb::txn &txn) {m_dbiWrap.clear(txn);}
+
+        // The underlying DB handle, for raw LMDB calls (cursors, mdb_cmp...)
+        MDB_dbi handle(lmdb::txn &txn) {return m_dbiWrap.handle(txn);}
+
+        // Looks up a batch of keys in one go; much quicker than get() in a loop
+        // for big batches (see DbiWrapper::getMany).
+        // out[i] is the array for keys[i], or a null span if it's missing, in
+        // which case found[i] is also false. Returns number found.
+        size_t getMany(lmdb::txn &txn, const std::vector<TAllKey> &keys,
+                       std::vector<LmdbSpan<TAllValElem>> &out, std::vector<bool> &found,
+                       bool prefetch = false) {
+            std::vector<MDB_val> vals;
+            const size_t res = m_dbiWrap.getMany(txn, keys.data(), keys.size(), vals, found, prefetch);
+            out.clear();
+            out.reserve(keys.size());
+            for(size_t i = 0; i < keys.size(); ++i)
+                out.push_back(found[i] ? detail::PodArrayValAdapt<TAllValElem>::from(vals[i])
+                                       : LmdbSpan<TAllValElem>::makeNull());
+            return res;
+        }
+
+        // Fast loading of key-sorted input (see BulkLoader)
+        BulkLoader<TAllKey, TAllValElem>
+        bulkLoader(DatabaseEnvironment &env, const BulkLoadOptions &opts = BulkLoadOptions{}) {
+            return BulkLoader<TAllKey, TAllValElem>{env, m_dbiWrap, opts};
+        }
+
+        // --- Iteration (see CursorRange)
+
+        using Range = CursorRange<TAllKey, detail::PodArrayValAdapt<TAllValElem>>;
+
+        Range scan(lmdb::txn &txn, ScanOrder order = ScanOrder::Forward) {
+            return Range::all(txn, m_dbiWrap.handle(txn), order);
+        }
+
+        // Keys in [lo, hi)
+        Range scanRange(lmdb::txn &txn, const TAllKey &lo, const TAllKey &hi,
+                        ScanOrder order = ScanOrder::Forward) {
+            return Range::between(txn, m_dbiWrap.handle(txn), lo, hi, order);
+        }
+
+        // Keys >= lo
+        Range scanFrom(lmdb::txn &txn, const TAllKey &lo, ScanOrder order = ScanOrder::Forward) {
+            return Range::from(txn, m_dbiWrap.handle(txn), lo, order);
+        }
+
+        template <typename TPrefix>
+        Range scanPrefix(lmdb::txn &txn, const TPrefix &prefix,
+                         ScanOrder order = ScanOrder::Forward) {
+            return Range::withPrefix(txn, m_dbiWrap.handle(txn), prefix, order);
+        }
+    };
+
+
+    // ======================================================================
+    // == MapDB_AutoPadded_Pod_PodArray ===
+    // ==
+    // ==   Similar to MapDB_Pod_PodAray, but wraps the user-provided
+    // ==   types in EightPadded automatically to comply with alignment reqs.
+    // ==
+    // ==   get() returns an LmdbSpan giving zero-copy access to the data in
+    // ==   the db, so you have to run operator*/get()/cget() on its members to
+    // ==   strip away the EightPadded before you can work with their values.
+    // ==   getView() wraps the same data in a PaddedSpan, which does that for
+    // ==   you (and can copy the values out densely, fast).
+    // ======================================================================
 
     template <typename TKey, typename TValElem>
     class MapDB_AutoPadded_Pod_PodArray {
         using PadKey     = EightPadded<TKey>;
         using PadValElem = EightPadded<TValElem>;
         
-        MapDB_Pod_PodArray<PadKey, PadValElem> m_db;
+        MapDB_Pod_PodArray<PadKey, PadValElem> m_db;
+
+    public:
+        explicit MapDB_AutoPadded_Pod_PodArray(const string &dbName) :m_db{dbName} {}
+        explicit MapDB_AutoPadded_Pod_PodArray(const string &dbName, const unsigned int dbiFlags)
+            :m_db{dbName, dbiFlags} {}
+
+        // Resolves the DB handle once, up front; prefer these on hot paths
+        explicit MapDB_AutoPadded_Pod_PodArray(DatabaseEnvironment &env, const string &dbName)
+            :m_db{env, dbName} {}
+        explicit MapDB_AutoPadded_Pod_PodArray(DatabaseEnvironment &env, const string &dbName,
+                                               const unsigned int dbiFlags)
+            :m_db{env, dbName, dbiFlags} {}
+        
+        template <typename Range>
+        void put(lmdb::txn &txn, const TKey &key, const Range &range) {
+            static_assert( std::is_same<
+                               typename std::remove_cv<TValElem>::type,
+                               typename std::remove_cv<typename Range::value_type>::type
+                             >::value,
+                           "Calling array put function with range containing wrong value_type" );
+      
+            // Pad straight into the space in the DB, rather than via a temp array
+            auto dest = m_db.reserve(txn, PadKey{key}, range.size());
+            size_t i = 0;
+            for(auto &o : range) dest[i++] = PadValElem{o};
+        }
+
+        LmdbWriteSpan<PadValElem>
+        reserve(lmdb::txn &txn, const TKey &key, size_t count) {
+            return m_db.reserve(txn, PadKey{key}, count);
+        }
+        
+        LmdbSpan<PadValElem>
+        get(lmdb::txn &txn, const TKey &key) {
+            return m_db.get(txn, PadKey{key});
+        }
+
+        PaddedSpan<TValElem>
+        getView(lmdb::txn &txn, const TKey &key) {
+            return PaddedSpan<TValElem>{ get(txn, key) };
+        }
+
+        bool exists(lmdb::txn &txn, const TKey &key) {
+            return m_db.exists(txn, PadKey{key});
+        }
+
+        bool erase(lmdb::txn &txn, const TKey &key) {return m_db.erase(txn, PadKey{key});}
+
+        size_t eraseRange(lmdb::txn &txn, const TKey &lo, const TKey &hi) {
+            return m_db.eraseRange(txn, PadKey{lo}, PadKey{hi});
+        }
+
+        void clear(lmdb::txn &txn) {m_db.clear(txn);}
+    };
+    
+
+    // ======================================================================
+    // == MapDB_Pod_PackedArray ===
+    // ==
+    // ==   Like MapDB_Pod_PodArray, but for element types that aren't a
+    // ==   multiple of 8 bytes (char, int16_t, small structs...), stored
+    // ==   densely rather than each padded out to 8 bytes as in
+    // ==   MapDB_AutoPadded_Pod_PodArray - up to 8x smaller on disk and in
+    // ==   the page cache.
+    // ==
+    // ==   Each value is a uint64_t element count followed by the elements,
+    // ==   with only the value as a whole padded out to a multiple of 8 bytes.
+    // ==   So the elements start 8-aligned, and any type with alignof <= 8
+    // ==   reads back in place, as a plain LmdbSpan<TAllValElem>.
+    // ==
+    // ==   Keys still need to be a multiple of 8 bytes, as everywhere else.
+    // ======================================================================
+
+    template <typename TAllKey, typename TAllValElem>
+    class MapDB_Pod_PackedArray {
+        static_assert(is_valid_keyval_type<TAllKey>::value, "");
+        static_assert(std::is_pod<TAllValElem>::value, "Packed array elements must be POD");
+        static_assert(alignof(TAllValElem) <= 8, "Packed array elements can't need more than 8-byte alignment");
+
+        using Header = uint64_t;
+
+        DbiWrapper m_dbiWrap;
+
+        // Words (incl header) taking count elements
+        static size_t valueWords(size_t count) {
+            return 1 + (count * sizeof(TAllValElem) + 7) / 8;
+        }
+
+    public:
+        // Flags used when you don't give any (see key_dbiflags)
+        static constexpr unsigned int defaultDbiFlags =
+            DbiWrapper::default_dbiflags | key_dbiflags<TAllKey>::value;
+
+        explicit MapDB_Pod_PackedArray(const string &dbName) :m_dbiWrap{dbName, defaultDbiFlags} {}
+        explicit MapDB_Pod_PackedArray(const string &dbName, const unsigned int dbiFlags)
+            :m_dbiWrap{dbName, dbiFlags} {}
+
+        // Resolves the DB handle once, up front; prefer these on hot paths
+        explicit MapDB_Pod_PackedArray(DatabaseEnvironment &env, const string &dbName)
+            :m_dbiWrap{env, dbName, defaultDbiFlags} {}
+        explicit MapDB_Pod_PackedArray(DatabaseEnvironment &env, const string &dbName,
+                                       const unsigned int dbiFlags)
+            :m_dbiWrap{env, dbName, dbiFlags} {}
+
+        LmdbSpan<TAllValElem>
+        get(lmdb::txn &txn, const TAllKey &key) {
+            LmdbSpan<unsigned char> sp = m_dbiWrap.get(txn, key);
+            return detail::PackedArrayValAdapt<TAllValElem>::from(detail::toMdbVal(sp.begin(), sp.size()));
+        }
+
+        // Zero-copy put: makes space for count elements in the DB and returns
+        // it for you to write the value straight into (see LmdbWriteSpan).
+        // The header and the trailing padding are already filled in.
+        LmdbWriteSpan<TAllValElem>
+        reserve(lmdb::txn &txn, const TAllKey &key, size_t count) {
+            auto words = m_dbiWrap.reserveArray<TAllKey, Header>(txn, key, valueWords(count));
+            words[words.size() - 1] = 0;  // Zero the padding; elements overwrite what they need
+            words[0] = count;
+            return LmdbWriteSpan<TAllValElem>{reinterpret_cast<TAllValElem *>(&words[0] + 1), count};
+        }
+
+        void put(lmdb::txn &txn, const TAllKey &key, const TAllValElem *data, size_t count) {
+            auto dest = reserve(txn, key, count);
+            if(count) memcpy(dest.begin(), data, count * sizeof(TAllValElem));
+        }
+
+        void put(lmdb::txn &txn, const TAllKey &key, const std::vector<TAllValElem> &vals) {
+            put(txn, key, vals.data(), vals.size());
+        }
+
+        bool exists( lmdb::txn &txn, const TAllKey &key ) {
+            return m_dbiWrap.exists(txn, key);
+        }
+
+        // As MapDB_Pod_PodArray's
+        bool erase(lmdb::txn &txn, const TAllKey &key) {return m_dbiWrap.del(txn, key);}
+        size_t eraseRange(lmdb::txn &txn, const TAllKey &lo, const TAllKey &hi) {
+            return m_dbiWrap.delRange(txn, lo, hi);
+        }
+        void clear(lmdb::txn &txn) {m_dbiWrap.clear(txn);}
+
+        // The underlying DB handle, for raw LMDB calls (cursors, mdb_cmp...)
+        MDB_dbi handle(lmdb::txn &txn) {return m_dbiWrap.handle(txn);}
+
+        // As MapDB_Pod_PodArray::getMany
+        size_t getMany(lmdb::txn &txn, const std::vector<TAllKey> &keys,
+                       std::vector<LmdbSpan<TAllValElem>> &out, std::vector<bool> &found,
+                       bool prefetch = false) {
+            std::vector<MDB_val> vals;
+            const size_t res = m_dbiWrap.getMany(txn, keys.data(), keys.size(), vals, found, prefetch);
+            out.clear();
+            out.reserve(keys.size());
+            for(size_t i = 0; i < keys.size(); ++i)
+                out.push_back(found[i] ? detail::PackedArrayValAdapt<TAllValElem>::from(vals[i])
+                                       : LmdbSpan<TAllValElem>::makeNull());
+            return res;
+        }
+
+        // --- Iteration (see CursorRange)
+
+        using Range = CursorRange<TAllKey, detail::PackedArrayValAdapt<TAllValElem>>;
+
+        Range scan(lmdb::txn &txn, ScanOrder order = ScanOrder::Forward) {
+            return Range::all(txn, m_dbiWrap.handle(txn), order);
+        }
+
+        // Keys in [lo, hi)
+        Range scanRange(lmdb::txn &txn, const TAllKey &lo, const TAllKey &hi,
+                        ScanOrder order = ScanOrder::Forward) {
+            return Range::between(txn, m_dbiWrap.handle(txn), lo, hi, order);
+        }
+
+        // Keys >= lo
+        Range scanFrom(lmdb::txn &txn, const TAllKey &lo, ScanOrder order = ScanOrder::Forward) {
+            return Range::from(txn, m_dbiWrap.handle(txn), lo, order);
+        }
+
+        template <typename TPrefix>
+        Range scanPrefix(lmdb::txn &txn, const TPrefix &prefix,
+                         ScanOrder order = ScanOrder::Forward) {
+            return Range::withPrefix(txn, m_dbiWrap.handle(txn), prefix, order);
+        }
+    };
+    
+
+    // ======================================================================
+    // == MapDB_Pod_ChunkedArray ===
+    // ==
+    // ==   Like MapDB_Pod_PodArray, but for big arrays (tens of MB, say) that
+    // ==   you add to or read parts of. A value over about half a page goes
+    // ==   to LMDB overflow pages, one contiguous run of them, so rewriting it
+    // ==   means finding a whole new run: slow, and it fragments the file.
+    // ==
+    // ==   Here each array is split into chunks of chunkBytes (default 64KB),
+    // ==   stored under (key, chunk number) entries of their own:
+    // ==
+    // ==     - getRange()/forEachSpan() read just the chunks covering the
+    // ==       [offset, offset + count) elements you ask for
+    // ==     - append() rewrites only the last (partial) chunk, then adds new
+    // ==       ones; earlier chunks aren't touched
+    // ==
+    // ==   Arrays up to inlineMaxBytes (default 1KB) live in a single entry
+    // ==   instead, and tryGetContiguous() hands those back zero-copy just as
+    // ==   MapDB_Pod_PodArray::get() does.
+    // ==
+    // ==   Entry 0 for each key holds a header (length, elements per chunk),
+    // ==   and the data itself if it's inline. The chunk size is recorded per
+    // ==   array, so changing the options later only affects new puts.
+    // ==
+    // ==   Keys are stored with the chunk number appended (big-endian, so
+    // ==   chunks sort in order), so this collection doesn't offer key scans.
+    // ======================================================================
+
+    struct ChunkedArrayOptions {
+        size_t chunkBytes     = 64UL * 1024UL;
+        size_t inlineMaxBytes = 1024;
+    };
+
+    namespace detail {
+        template <typename TAllKey>
+        struct ChunkKey {
+            TAllKey key;
+            unsigned char chunkBE[8];
+
+            static ChunkKey of(const TAllKey &key, uint64_t chunk) {
+                ChunkKey res;
+                res.key = key;
+                for(size_t i = 0; i < 8; ++i) res.chunkBE[i] = static_cast<unsigned char>(chunk >> (56 - 8 * i));
+                return res;
+            }
+        };
+
+        struct ChunkedHeader {
+            uint64_t count;
+            uint64_t elemsPerChunk;  // 0 if the data is inline, after the header
+        };
+    }
+
+    template <typename TAllKey, typename TAllValElem>
+    class MapDB_Pod_ChunkedArray {
+        static_assert(is_valid_keyval_type<TAllKey>::value, "");
+        static_assert(is_valid_keyval_type<TAllValElem>::value, "");
+
+        using ChunkKey = detail::ChunkKey<TAllKey>;
+        using Header   = detail::ChunkedHeader;
+        static_assert(is_valid_keyval_type<ChunkKey>::value, "");
+        static_assert(sizeof(Header) % sizeof(uint64_t) == 0, "");
+
+        DbiWrapper m_dbiWrap;
+        ChunkedArrayOptions m_opts;
+
+        size_t elemsPerChunk() const {
+            const size_t res = m_opts.chunkBytes / sizeof(TAllValElem);
+            return res ? res : 1;
+        }
+
+        bool readHeader(lmdb::txn &txn, const TAllKey &key, Header &hdr, LmdbSpan<TAllValElem> &inl) {
+            MDB_val mv;
+            if(! m_dbiWrap.tryGet(txn, ChunkKey::of(key, 0), mv)) return false;
+            LmdbSpan<unsigned char> sp {mv};
+            assert( sp.size() >= sizeof(Header) );
+            memcpy(&hdr, sp.begin(), sizeof(Header));
+            inl = LmdbSpan<TAllValElem>{reinterpret_cast<const TAllValElem *>(sp.begin() + sizeof(Header)),
+                                        hdr.elemsPerChunk ? 0 : static_cast<size_t>(hdr.count)};
+            return true;
+        }
+
+        // Data chunk n (0-based) is stored as entry n + 1
+        LmdbSpan<TAllValElem> readChunk(lmdb::txn &txn, const TAllKey &key, uint64_t n) {
+            return m_dbiWrap.get(txn, ChunkKey::of(key, n + 1)).template asSpan<TAllValElem>();
+        }
+
+        void writeHeader(lmdb::txn &txn, const TAllKey &key, const Header &hdr,
+                         const TAllValElem *inlineData) {
+            const size_t inlineCount = hdr.elemsPerChunk ? 0 : static_cast<size_t>(hdr.count);
+            const size_t words = (sizeof(Header) + inlineCount * sizeof(TAllValElem)) / sizeof(uint64_t);
+            auto dest = m_dbiWrap.reserveArray<ChunkKey, uint64_t>(txn, ChunkKey::of(key, 0), words);
+            memcpy(&dest[0], &hdr, sizeof(Header));
+            if(inlineCount)
+                memcpy(&dest[0] + sizeof(Header) / sizeof(uint64_t), inlineData,
+                       inlineCount * sizeof(TAllValElem));
+        }
+
+        void writeChunks(lmdb::txn &txn, const TAllKey &key, uint64_t firstChunk,
+                         const TAllValElem *data, size_t count, size_t perChunk) {
+            for(uint64_t n = firstChunk; count; ++n) {
+                const size_t take = count < perChunk ? count : perChunk;
+                m_dbiWrap.putArray(txn, ChunkKey::of(key, n + 1), data, take);
+                data += take;
+                count -= take;
+            }
+        }
+
+        static uint64_t numChunks(const Header &hdr) {
+            return hdr.elemsPerChunk ? (hdr.count + hdr.elemsPerChunk - 1) / hdr.elemsPerChunk : 0;
+        }
+
+    public:
+        static constexpr unsigned int defaultDbiFlags = DbiWrapper::default_dbiflags;
+
+        explicit MapDB_Pod_ChunkedArray(const string &dbName,
+                                        const ChunkedArrayOptions &opts = ChunkedArrayOptions{})
+            :m_dbiWrap{dbName, defaultDbiFlags}, m_opts(opts) {}
+
+        // Resolves the DB handle once, up front; prefer these on hot paths
+        explicit MapDB_Pod_ChunkedArray(DatabaseEnvironment &env, const string &dbName,
+                                        const ChunkedArrayOptions &opts = ChunkedArrayOptions{})
+            :m_dbiWrap{env, dbName, defaultDbiFlags}, m_opts(opts) {}
+
+        // Replaces any existing array under key
+        void put(lmdb::txn &txn, const TAllKey &key, const TAllValElem *data, size_t count) {
+            erase(txn, key);
+            Header hdr {count, 0};
+            if(count * sizeof(TAllValElem) > m_opts.inlineMaxBytes) {
+                hdr.elemsPerChunk = elemsPerChunk();
+                writeChunks(txn, key, 0, data, count, hdr.elemsPerChunk);
+            }
+            writeHeader(txn, key, hdr, data);
+        }
+
+        void put(lmdb::txn &txn, const TAllKey &key, const std::vector<TAllValElem> &vals) {
+            put(txn, key, vals.data(), vals.size());
+        }
+
+        // Adds count elements to the end of key's array (creating it if need be)
+        void append(lmdb::txn &txn, const TAllKey &key, const TAllValElem *data, size_t count) {
+            Header hdr;
+            auto inl = LmdbSpan<TAllValElem>::makeNull();
+            if(! readHeader(txn, key, hdr, inl)) {
+                put(txn, key, data, count);
+                return;
+            }
+            if(! count) return;
+
+            if(! hdr.elemsPerChunk) {
+                // Still small: rewrite the lot, which may now chunk it. Copy
+                // first, as the rewrite can move what inl points at.
+                auto all = std::vector<TAllValElem>(inl.begin(), inl.end());
+                all.insert(all.end(), data, data + count);
+                put(txn, key, all);
+                return;
+            }
+
+            const size_t perChunk = static_cast<size_t>(hdr.elemsPerChunk);
+            uint64_t nextChunk = numChunks(hdr);
+            const size_t lastFill = static_cast<size_t>(hdr.count - (nextChunk - 1) * perChunk);
+            if(nextChunk && lastFill < perChunk) {
+                // Top up the last chunk; the only existing one we rewrite
+                const size_t take = count < perChunk - lastFill ? count : perChunk - lastFill;
+                auto last = readChunk(txn, key, nextChunk - 1);
+                auto merged = std::vector<TAllValElem>(last.begin(), last.end());
+                merged.insert(merged.end(), data, data + take);
+                m_dbiWrap.putArray(txn, ChunkKey::of(key, nextChunk), merged.data(), merged.size());
+                data += take;
+                count -= take;
+                hdr.count += take;
+            }
+            writeChunks(txn, key, nextChunk, data, count, perChunk);
+            hdr.count += count;
+            writeHeader(txn, key, hdr, nullptr);
+        }
+
+        // Removes key's array; false if there wasn't one
+        bool erase(lmdb::txn &txn, const TAllKey &key) {
+            Header hdr;
+            auto inl = LmdbSpan<TAllValElem>::makeNull();
+            if(! readHeader(txn, key, hdr, inl)) return false;
+            const uint64_t chunks = numChunks(hdr);
+            for(uint64_t n = 0; n < chunks; ++n) m_dbiWrap.del(txn, ChunkKey::of(key, n + 1));
+            m_dbiWrap.del(txn, ChunkKey::of(key, 0));
+            return true;
+        }
+
+        bool exists(lmdb::txn &txn, const TAllKey &key) {
+            return m_dbiWrap.exists(txn, ChunkKey::of(key, 0));
+        }
+
+        // Number of elements in key's array (throws lmdb::not_found_error if none)
+        size_t size(lmdb::txn &txn, const TAllKey &key) {
+            Header hdr;
+            auto inl = LmdbSpan<TAllValElem>::makeNull();
+            if(! readHeader(txn, key, hdr, inl))
+                lmdb::error::raise("ChunkedArray SIZE error", MDB_NOTFOUND);
+            return static_cast<size_t>(hdr.count);
+        }
+
+        // Fast path for small arrays: the whole array zero-copy if it's
+        // stored inline, else a null span (and you want getRange())
+        LmdbSpan<TAllValElem> tryGetContiguous(lmdb::txn &txn, const TAllKey &key) {
+            Header hdr;
+            auto inl = LmdbSpan<TAllValElem>::makeNull();
+            if(! readHeader(txn, key, hdr, inl))
+                lmdb::error::raise("ChunkedArray GET error", MDB_NOTFOUND);
+            return hdr.elemsPerChunk ? LmdbSpan<TAllValElem>::makeNull() : inl;
+        }
+
+        // Calls fn(LmdbSpan<TAllValElem>) on zero-copy pieces covering elements
+        // [offset, offset + count) of key's array, in order - one per chunk
+        template <typename Fn>
+        void forEachSpan(lmdb::txn &txn, const TAllKey &key, size_t offset, size_t count, Fn fn) {
+            Header hdr;
+            auto inl = LmdbSpan<TAllValElem>::makeNull();
+            if(! readHeader(txn, key, hdr, inl))
+                lmdb::error::raise("ChunkedArray GET RANGE error", MDB_NOTFOUND);
+            if(offset > hdr.count || count > hdr.count - offset)
+                throw std::out_of_range("ChunkedArray range past end of array");
+            if(! count) return;
+
+            if(! hdr.elemsPerChunk) {
+                fn(inl.subSpan(offset, count));
+                return;
+            }
+            const size_t perChunk = static_cast<size_t>(hdr.elemsPerChunk);
+            uint64_t n = offset / perChunk;
+            size_t within = offset % perChunk;
+            while(count) {
+                auto chunk = readChunk(txn, key, n++);
+                const size_t take = count < chunk.size() - within ? count : chunk.size() - within;
+                fn(chunk.subSpan(within, take));
+                count -= take;
+                within = 0;
+            }
+        }
+
+        // Copies elements [offset, offset + count) of key's array into out
+        void getRange(lmdb::txn &txn, const TAllKey &key, size_t offset, size_t count,
+                      std::vector<TAllValElem> &out) {
+            out.clear();
+            out.reserve(count);
+            forEachSpan(txn, key, offset, count, [&out](LmdbSpan<TAllValElem> sp) {
+                    out.insert(out.end(), sp.begin(), sp.end()); });
+        }
+
+        // Copies the whole array into out
+        void get(lmdb::txn &txn, const TAllKey &key, std::vector<TAllValElem> &out) {
+            getRange(txn, key, 0, size(txn, key), out);
+        }
+    };
+
+
+    // ======================================================================
+    // == DeltaVarintCodec ===
+    // ==
+    // ==   Default codec for MapDB_Pod_CompressedArray. Treats each element
+    // ==   as a row of 64-bit words and, a column at a time, stores each word
+    // ==   as its difference from the one above it, zigzagged and varint
+    // ==   encoded. Slowly changing series (timestamps, ids, positions -
+    // ==   doubles too, as their bit patterns change slowly) shrink a lot.
+    // ==
+    // ==   You can plug in your own (e.g. wrapping LZ4 or zstd): a codec is a
+    // ==   type with the same three static members, and a unique nonzero id
+    // ==   (0 marks values stored raw). decode() must reject malformed input
+    // ==   by returning false rather than reading past inLen.
+    // ======================================================================
+
+    struct DeltaVarintCodec {
+        static constexpr uint8_t id = 1;
+
+        // Appends the encoding of numElems rows of elemWords words to out
+        static void encode(const void *data, size_t numElems, size_t elemWords,
+                           std::vector<unsigned char> &out) {
+            const auto bytes = static_cast<const unsigned char *>(data);
+            for(size_t col = 0; col < elemWords; ++col) {
+                uint64_t prev = 0;
+                for(size_t e = 0; e < numElems; ++e) {
+                    uint64_t w;
+                    memcpy(&w, bytes + (e * elemWords + col) * 8, 8);
+                    const uint64_t delta = w - prev;
+                    prev = w;
+                    uint64_t zz = (delta << 1) ^ (0 - (delta >> 63));
+                    while(zz >= 0x80) {
+                        out.push_back(static_cast<unsigned char>(zz | 0x80));
+                        zz >>= 7;
+                    }
+                    out.push_back(static_cast<unsigned char>(zz));
+                }
+            }
+        }
+
+        // Fills out (numElems * elemWords words) from in; false if in is bad
+        static bool decode(const unsigned char *in, size_t inLen, uint64_t *out,
+                           size_t numElems, size_t elemWords) {
+            const unsigned char *p = in, *end = in + inLen;
+            for(size_t col = 0; col < elemWords; ++col) {
+                uint64_t prev = 0;
+                for(size_t e = 0; e < numElems; ++e) {
+                    uint64_t zz = 0;
+                    for(unsigned shift = 0; ; shift += 7) {
+                        if(p == end || shift > 63) return false;
+                        const unsigned char b = *p++;
+                        zz |= static_cast<uint64_t>(b & 0x7F) << shift;
+                        if(!(b & 0x80)) break;
+                    }
+                    prev += (zz >> 1) ^ (0 - (zz & 1));
+                    out[e * elemWords + col] = prev;
+                }
+            }
+            return true;
+        }
+    };
+
+
+    // ======================================================================
+    // == CompressionArena ===
+    // ==
+    // ==   Where MapDB_Pod_CompressedArray decodes values to. Spans it hands
+    // ==   out stay valid until reset(), so you can hold several at once;
+    // ==   reset() between batches and the memory gets reused.
+    // ======================================================================
+
+    class CompressionArena {
+        static constexpr size_t minBlockWords = 4096;
+
+        std::vector<std::unique_ptr<uint64_t[]>> m_blocks;
+        std::vector<size_t> m_blockWords;
+        size_t m_used = 0;  // Words used in the last block
+
+    public:
+        // Space for n 8-aligned words
+        uint64_t *alloc(size_t n) {
+            if(m_blocks.empty() || m_used + n > m_blockWords.back()) {
+                const size_t words = n > minBlockWords ? n : minBlockWords;
+                m_blocks.emplace_back(new uint64_t[words]);
+                m_blockWords.push_back(words);
+                m_used = 0;
+            }
+            uint64_t *res = m_blocks.back().get() + m_used;
+            m_used += n;
+            return res;
+        }
+
+        // Invalidates everything handed out so far
+        void reset() {
+            // Fold the blocks into one big enough for the lot, so steady state
+            // is one block and no allocations
+            if(m_blocks.size() > 1) {
+                size_t total = 0;
+                for(auto w : m_blockWords) total += w;
+                m_blocks.clear();
+                m_blockWords.clear();
+                m_blocks.emplace_back(new uint64_t[total]);
+                m_blockWords.push_back(total);
+            }
+            m_used = 0;
+        }
+    };
+
+
+    // ======================================================================
+    // == MapDB_Pod_CompressedArray ===
+    // ==
+    // ==   Like MapDB_Pod_PodArray, but compresses each value on put (see
+    // ==   DeltaVarintCodec, or give your own Codec), trading some CPU on
+    // ==   each get for less disk, less I/O and more of your data fitting in
+    // ==   the page cache. Worth it when the DB outgrows RAM.
+    // ==
+    // ==   Values under minCompressBytes (default 256), and ones the codec
+    // ==   doesn't make smaller, are stored raw and come back zero-copy as
+    // ==   with MapDB_Pod_PodArray. Compressed ones are decoded into an arena:
+    // ==
+    // ==     - get(txn, key, arena) decodes into yours; the span is valid
+    // ==       until you reset() the arena (or the txn ends, for raw values)
+    // ==     - get(txn, key) uses a thread-local one, which it resets each
+    // ==       time; the span is valid until your next such get on the thread
+    // ==
+    // ==   Each value starts with a uint64_t header: element count << 8,
+    // ==   with the codec id in the low byte.
+    // ==
+    // ==   stats() counts what this collection object has written and
+    // ==   decoded, for judging the compression ratio; it isn't persisted.
+    // ======================================================================
+
+    struct CompressionStats {
+        size_t valuesRaw        = 0;  // Puts stored uncompressed
+        size_t valuesCompressed = 0;
+        size_t inputBytes       = 0;  // Array bytes given to put()
+        size_t storedBytes      = 0;  // Value bytes written to the DB, incl headers
+        size_t decodes          = 0;
+
+        double ratio() const {return storedBytes ? double(inputBytes) / storedBytes : 1.0;}
+    };
+
+    template <typename TAllKey, typename TAllValElem, typename Codec = DeltaVarintCodec>
+    class MapDB_Pod_CompressedArray {
+        static_assert(is_valid_keyval_type<TAllKey>::value, "");
+        static_assert(is_valid_keyval_type<TAllValElem>::value, "");
+        static_assert(Codec::id != 0, "Codec id 0 is reserved for raw values");
+
+        static constexpr size_t elemWords = sizeof(TAllValElem) / 8;
+        static constexpr uint8_t rawId = 0;
+
+        struct Counters {
+            std::atomic<size_t> valuesRaw {0}, valuesCompressed {0},
+                                inputBytes {0}, storedBytes {0}, decodes {0};
+        };
+
+        DbiWrapper m_dbiWrap;
+        std::unique_ptr<Counters> m_counters {new Counters};
+        size_t m_minCompressBytes = defaultMinCompressBytes;
+
+        LmdbSpan<TAllValElem> decodeVal(const MDB_val &mv, CompressionArena &arena) {
+            if(mv.mv_size < sizeof(uint64_t))
+                throw std::runtime_error("CompressedArray value too short for its header");
+            const uint64_t header = LmdbSpan<uint64_t>{mv}[0];
+            const size_t count = static_cast<size_t>(header >> 8);
+            const uint8_t codec = static_cast<uint8_t>(header & 0xFF);
+            const unsigned char *body = static_cast<const unsigned char *>(mv.mv_data) + sizeof(uint64_t);
+            const size_t bodyLen = mv.mv_size - sizeof(uint64_t);
+
+            if(codec == rawId) {
+                assert( count * sizeof(TAllValElem) <= bodyLen );
+                return LmdbSpan<TAllValElem>{reinterpret_cast<const TAllValElem *>(body), count};
+            }
+            if(codec != Codec::id)
+                throw std::runtime_error("CompressedArray value was written with a different codec");
+
+            uint64_t *dest = arena.alloc(count * elemWords);
+            if(!Codec::decode(body, bodyLen, dest, count, elemWords))
+                throw std::runtime_error("CompressedArray value is corrupt");
+            m_counters->decodes.fetch_add(1, std::memory_order_relaxed);
+            return LmdbSpan<TAllValElem>{reinterpret_cast<const TAllValElem *>(dest), count};
+        }
+
+        static CompressionArena &threadArena() {
+            static thread_local CompressionArena arena;
+            return arena;
+        }
+
+    public:
+        static constexpr size_t defaultMinCompressBytes = 256;
+
+        // Flags used when you don't give any (see key_dbiflags)
+        static constexpr unsigned int defaultDbiFlags =
+            DbiWrapper::default_dbiflags | key_dbiflags<TAllKey>::value;
+
+        explicit MapDB_Pod_CompressedArray(const string &dbName) :m_dbiWrap{dbName, defaultDbiFlags} {}
+        explicit MapDB_Pod_CompressedArray(const string &dbName, const unsigned int dbiFlags)
+            :m_dbiWrap{dbName, dbiFlags} {}
+
+        // Resolves the DB handle once, up front; prefer these on hot paths
+        explicit MapDB_Pod_CompressedArray(DatabaseEnvironment &env, const string &dbName)
+            :m_dbiWrap{env, dbName, defaultDbiFlags} {}
+        explicit MapDB_Pod_CompressedArray(DatabaseEnvironment &env, const string &dbName,
+                                           const unsigned int dbiFlags)
+            :m_dbiWrap{env, dbName, dbiFlags} {}
+
+        // Values smaller than this (in bytes) are always stored raw
+        void setMinCompressBytes(size_t bytes) {m_minCompressBytes = bytes;}
+
+        void put(lmdb::txn &txn, const TAllKey &key, const TAllValElem *data, size_t count) {
+            const size_t rawBytes = count * sizeof(TAllValElem);
+
+            static thread_local std::vector<unsigned char> encoded;
+            encoded.clear();
+            if(rawBytes >= m_minCompressBytes) Codec::encode(data, count, elemWords, encoded);
+            const bool compress = !encoded.empty() && encoded.size() < rawBytes;
+
+            const size_t bodyLen = compress ? encoded.size() : rawBytes;
+            auto words = m_dbiWrap.reserveArray<TAllKey, uint64_t>(txn, key, 1 + (bodyLen + 7) / 8);
+            words[words.size() - 1] = 0;  // Zero the padding
+            const uint64_t codecId = compress ? uint64_t{Codec::id} : uint64_t{rawId};
+            words[0] = (static_cast<uint64_t>(count) << 8) | codecId;
+            const void *body = compress ? static_cast<const void *>(encoded.data())
+                                        : static_cast<const void *>(data);
+            if(bodyLen) memcpy(&words[0] + 1, body, bodyLen);
+
+            (compress ? m_counters->valuesCompressed : m_counters->valuesRaw)
+                .fetch_add(1, std::memory_order_relaxed);
+            m_counters->inputBytes.fetch_add(rawBytes, std::memory_order_relaxed);
+            m_counters->storedBytes.fetch_add(words.size() * 8, std::memory_order_relaxed);
+        }
+
+        void put(lmdb::txn &txn, const TAllKey &key, const std::vector<TAllValElem> &vals) {
+            put(txn, key, vals.data(), vals.size());
+        }
+
+        LmdbSpan<TAllValElem>
+        get(lmdb::txn &txn, const TAllKey &key, CompressionArena &arena) {
+            LmdbSpan<unsigned char> sp = m_dbiWrap.get(txn, key);
+            return decodeVal(detail::toMdbVal(sp.begin(), sp.size()), arena);
+        }
+
+        LmdbSpan<TAllValElem>
+        get(lmdb::txn &txn, const TAllKey &key) {
+            auto &arena = threadArena();
+            arena.reset();
+            return get(txn, key, arena);
+        }
+
+        bool exists( lmdb::txn &txn, const TAllKey &key ) {
+            return m_dbiWrap.exists(txn, key);
+        }
+
+        // As MapDB_Pod_PodArray's
+        bool erase(lmdb::txn &txn, const TAllKey &key) {return m_dbiWrap.del(txn, key);}
+        size_t eraseRange(lmdb::txn &txn, const TAllKey &lo, const TAllKey &hi) {
+            return m_dbiWrap.delRange(txn, lo, hi);
+        }
+        void clear(lmdb::txn &txn) {m_dbiWrap.clear(txn);}
+
+        // Calls fn(const TAllKey&, LmdbSpan<TAllValElem>) for each entry, in key
+        // order. Each span is only valid during its call.
+        template <typename Fn>
+        void forEach(lmdb::txn &txn, Fn fn) {
+            using RawRange = CursorRange<TAllKey, detail::RawValAdapt>;
+            CompressionArena arena;
+            for(auto kv : RawRange::all(txn, m_dbiWrap.handle(txn), ScanOrder::Forward)) {
+                arena.reset();
+                fn(kv.first, decodeVal(kv.second, arena));
+            }
+        }
+
+        CompressionStats stats() const {
+            CompressionStats res;
+            res.valuesRaw        = m_counters->valuesRaw.load();
+            res.valuesCompressed = m_counters->valuesCompressed.load();
+            res.inputBytes       = m_counters->inputBytes.load();
+            res.storedBytes      = m_counters->storedBytes.load();
+            res.decodes          = m_counters->decodes.load();
+            return res;
+        }
+    };
+
+
+    // ======================================================================
+    // == ColumnarDB ===
+    // ==
+    // ==   Stores a POD struct column-wise rather than row-wise: each field
+    // ==   you list gets its own DB, holding that field's values for blocks
+    // ==   of rowsPerBlock (default 4096) consecutive keys as one packed array
+    // ==   (see MapDB_Pod_PackedArray). A scan over one field then only pulls
+    // ==   that field's bytes through the page cache, and hands them to you as
+    // ==   contiguous LmdbSpans, ready for a vectorised loop.
+    // ==
+    // ==       struct Trade { uint64_t time; double price; int32_t qty; };
+    // ==       using Trades = ColumnarDB<uint64_t, Trade,
+    // ==                                 LMDBCOLS_FIELD(Trade, price),
+    // ==                                 LMDBCOLS_FIELD(Trade, qty)>;
+    // ==
+    // ==       for(auto blk : trades.column<0>(txn))   // price
+    // ==           for(double p : blk.second) total += p;
+    // ==
+    // ==   A further DB holds each block's keys. Every DB is keyed by the
+    // ==   block's first key, so column<I>() ranges all visit blocks in the
+    // ==   same order, and can be walked side by side with keyBlocks().
+    // ==   get() reassembles a whole record for one key.
+    // ==
+    // ==   Writes go through an Appender, in ascending key order, after any
+    // ==   keys already stored: this is a store for bulk-loaded analytic data,
+    // ==   not for updating individual records.
+    // ==
+    // ==   Fields not listed are left alone by get() (and not stored).
+    // ==   Takes 1 + number-of-fields named DBs from your EnvOptions::maxDbs.
+    // ======================================================================
+
+    template <typename S, typename T, T S::*Member>
+    struct ColumnField {
+        using struct_type = S;
+        using type        = T;
+        static T S::*member() {return Member;}
+        static const T &of(const S &s) {return s.*Member;}  // (So it also works as an index extractor)
+    };
+
+#define LMDBCOLS_FIELD(S, m) ::lmdbcols::ColumnField<S, decltype(S::m), &S::m>
+
+    namespace detail {
+        // Position of T in Ts...
+        template <typename T, typename ...Ts> struct IndexOf;
+        template <typename T, typename ...Ts>
+        struct IndexOf<T, T, Ts...> : std::integral_constant<size_t, 0> {};
+        template <typename T, typename U, typename ...Ts>
+        struct IndexOf<T, U, Ts...> : std::integral_constant<size_t, 1 + IndexOf<T, Ts...>::value> {};
+    }
+
+    template <typename TAllKey, typename TStruct, typename ...Fields>
+    class ColumnarDB {
+        static_assert(std::is_pod<TStruct>::value, "");
+        static_assert(sizeof...(Fields) > 0, "ColumnarDB needs at least one field");
+
+        template <typename F> using ColDb = MapDB_Pod_PackedArray<TAllKey, typename F::type>;
+        using KeysDb = MapDB_Pod_PackedArray<TAllKey, TAllKey>;
+
+        KeysDb m_keys;
+        std::tuple<ColDb<Fields>...> m_columns;
+        size_t m_rowsPerBlock;
+
+        static string columnName(const string &dbName, size_t i) {
+            return dbName + ".col" + std::to_string(i);
+        }
+
+        // -- Per-field recursion (I counts up through Fields)
+
+        template <size_t I>
+        typename std::enable_if<I == sizeof...(Fields)>::type
+        fillFields(lmdb::txn &, const TAllKey &, size_t, TStruct &) {}
+
+        template <size_t I>
+        typename std::enable_if<I < sizeof...(Fields)>::type
+        fillFields(lmdb::txn &txn, const TAllKey &blockKey, size_t row, TStruct &out) {
+            using F = typename std::tuple_element<I, std::tuple<Fields...>>::type;
+            out.*(F::member()) = std::get<I>(m_columns).get(txn, blockKey)[row];
+            fillFields<I + 1>(txn, blockKey, row, out);
+        }
+
+        int compareKeys(lmdb::txn &txn, const TAllKey &a, const TAllKey &b) {
+            MDB_val ma = detail::toMdbVal(a), mb = detail::toMdbVal(b);
+            return mdb_cmp(txn, m_keys.handle(txn), &ma, &mb);
+        }
+
+        // The block holding key (its first key, and the block's keys), if any
+        bool findBlock(lmdb::txn &txn, const TAllKey &key,
+                       TAllKey &blockKey, LmdbSpan<TAllKey> &blockKeys) {
+            auto cursor = lmdb::cursor::open(txn, m_keys.handle(txn));
+            MDB_val mkey = detail::toMdbVal(key);
+            MDB_val mval;
+            int rc = mdb_cursor_get(cursor, &mkey, &mval, MDB_SET_RANGE);
+            if(rc == 0 && compareKeys(txn, LmdbSpan<unsigned char>{mkey}.asType<TAllKey>(), key) != 0)
+                rc = mdb_cursor_get(cursor, &mkey, &mval, MDB_PREV);
+            else if(rc == MDB_NOTFOUND)
+                rc = mdb_cursor_get(cursor, &mkey, &mval, MDB_LAST);
+            if(rc == MDB_NOTFOUND) return false;
+            if(rc) lmdb::error::raise("ColumnarDB block seek", rc);
+            blockKey  = LmdbSpan<unsigned char>{mkey}.asType<TAllKey>();
+            blockKeys = detail::PackedArrayValAdapt<TAllKey>::from(mval);
+            return true;
+        }
+
+    public:
+        static constexpr size_t defaultRowsPerBlock = 4096;
+
+        // The field type of column I
+        template <size_t I>
+        using column_type = typename std::tuple_element<I, std::tuple<Fields...>>::type::type;
+
+        explicit ColumnarDB(DatabaseEnvironment &env, const string &dbName,
+                            size_t rowsPerBlock = defaultRowsPerBlock)
+            :m_keys{env, dbName + ".keys"},
+             m_columns{ ColDb<Fields>{env, columnName(dbName, detail::IndexOf<Fields, Fields...>::value)}... },
+             m_rowsPerBlock{rowsPerBlock}
+        {
+            // (Compares each field's struct_type with one TStruct per field)
+            static_assert(std::is_same<std::tuple<typename Fields::struct_type...>,
+                                       std::tuple<typename std::conditional<true, TStruct, Fields>::type...>
+                                      >::value, "ColumnarDB fields must all be members of TStruct");
+            if(!rowsPerBlock) throw std::invalid_argument("ColumnarDB rowsPerBlock must be positive");
+        }
+
+        size_t rowsPerBlock() const {return m_rowsPerBlock;}
+
+        // Reassembles key's record into out (listed fields only); false if missing
+        bool get(lmdb::txn &txn, const TAllKey &key, TStruct &out) {
+            TAllKey blockKey;
+            LmdbSpan<TAllKey> blockKeys = LmdbSpan<TAllKey>::makeNull();
+            if(!findBlock(txn, key, blockKey, blockKeys)) return false;
+
+            auto it = std::lower_bound(blockKeys.begin(), blockKeys.end(), key,
+                                       [&](const TAllKey &a, const TAllKey &b) {
+                                           return compareKeys(txn, a, b) < 0; });
+            if(it == blockKeys.end() || compareKeys(txn, *it, key) != 0) return false;
+            fillFields<0>(txn, blockKey, static_cast<size_t>(it - blockKeys.begin()), out);
+            return true;
+        }
+
+        // --- Scans (see CursorRange); each entry is (block's first key, span)
+
+        using KeyRange = typename KeysDb::Range;
+
+        template <size_t I>
+        using ColumnRange = typename ColDb<typename std::tuple_element<I, std::tuple<Fields...>>::type>::Range;
+
+        // Every key, a block at a time
+        KeyRange keyBlocks(lmdb::txn &txn) {return m_keys.scan(txn);}
+
+        // Every value of field I, a block at a time, in key order
+        template <size_t I>
+        ColumnRange<I> column(lmdb::txn &txn) {return std::get<I>(m_columns).scan(txn);}
+
+        // --- Writing
+
+        // Buffers records and writes them out a block at a time, through the
+        // txn you give. Call finish() before committing, to write the last
+        // (partial) block.
+        class Appender {
+            ColumnarDB &m_db;
+            lmdb::txn &m_txn;
+            std::vector<TAllKey> m_blockKeys;
+            std::tuple<std::vector<typename Fields::type>...> m_blockCols;
+            TAllKey m_lastKey;
+            bool m_haveLastKey = false;
+
+            template <size_t I>
+            typename std::enable_if<I == sizeof...(Fields)>::type
+            addFields(const TStruct &) {}
+
+            template <size_t I>
+            typename std::enable_if<I < sizeof...(Fields)>::type
+            addFields(const TStruct &rec) {
+                using F = typename std::tuple_element<I, std::tuple<Fields...>>::type;
+                std::get<I>(m_blockCols).push_back(rec.*(F::member()));
+                addFields<I + 1>(rec);
+            }
+
+            template <size_t I>
+            typename std::enable_if<I == sizeof...(Fields)>::type
+            writeFields() {}
+
+            template <size_t I>
+            typename std::enable_if<I < sizeof...(Fields)>::type
+            writeFields() {
+                auto &vals = std::get<I>(m_blockCols);
+                std::get<I>(m_db.m_columns).put(m_txn, m_blockKeys[0], vals);
+                vals.clear();
+                writeFields<I + 1>();
+            }
+
+            void writeBlock() {
+                if(m_blockKeys.empty()) return;
+                m_db.m_keys.put(m_txn, m_blockKeys[0], m_blockKeys);
+                writeFields<0>();
+                m_blockKeys.clear();
+            }
+
+        public:
+            explicit Appender(ColumnarDB &db, lmdb::txn &txn) :m_db{db}, m_txn{txn} {
+                auto cursor = lmdb::cursor::open(txn, db.m_keys.handle(txn));
+                MDB_val mkey, mval;
+                const int rc = mdb_cursor_get(cursor, &mkey, &mval, MDB_LAST);
+                if(rc == 0) {
+                    auto keys = detail::PackedArrayValAdapt<TAllKey>::from(mval);
+                    assert( keys.size() );
+                    m_lastKey = keys[keys.size() - 1];
+                    m_haveLastKey = true;
+                }
+                else if(rc != MDB_NOTFOUND) lmdb::error::raise("ColumnarDB appender seek", rc);
+            }
+
+            // Keys must ascend, from past the last one already in the DB
+            void add(const TAllKey &key, const TStruct &rec) {
+                if(m_haveLastKey && m_db.compareKeys(m_txn, m_lastKey, key) >= 0)
+                    throw std::invalid_argument("ColumnarDB keys must be appended in ascending order");
+                m_lastKey = key;
+                m_haveLastKey = true;
+
+                m_blockKeys.push_back(key);
+                addFields<0>(rec);
+                if(m_blockKeys.size() >= m_db.m_rowsPerBlock) writeBlock();
+            }
+
+            void finish() {writeBlock();}
+        };
+
+        Appender appender(lmdb::txn &txn) {return Appender{*this, txn};}
+    };
+
+
+    // ======================================================================
+    // == MapDB_Pod_MultiPod ===
+    // ==
+    // ==   Maps each key to a sorted set of values, all of the one fixed-size
+    // ==   POD type: a one-to-many relation, e.g. a path to its waypoints.
+    // ==
+    // ==   Unlike keeping the set as a MapDB_Pod_PodArray value, adding or
+    // ==   removing one value is a single O(log n) LMDB op, not a rewrite of
+    // ==   the whole array. (It's an MDB_DUPSORT | MDB_DUPFIXED DB underneath.)
+    // ==
+    // ==   Values come back a page at a time (MDB_GET_MULTIPLE /
+    // ==   MDB_NEXT_MULTIPLE) as zero-copy LmdbSpans, in sorted order; by
+    // ==   memcmp, or numerically for native integer values (dup_dbiflags).
+    // ==
+    // ==   Same sizeof % 8 requirements as the other MapDB classes.
+    // ======================================================================
+
+    template <typename TAllKey, typename TAllVal>
+    class MapDB_Pod_MultiPod {
+        static_assert(is_valid_keyval_type<TAllKey>::value, "");
+        static_assert(is_valid_keyval_type<TAllVal>::value, "");
+        
+        DbiWrapper m_dbiWrap;
+
+        lmdb::cursor openCursor(lmdb::txn &txn) {
+            return lmdb::cursor::open(txn, m_dbiWrap.handle(txn));
+        }
+
+        // Puts cursor on key's first value, and gives it in first; false if
+        // key has none
+        static bool seekKey(MDB_cursor *cursor, const TAllKey &key, MDB_val &first) {
+            MDB_val mkey = detail::toMdbVal(key);
+            const int rc = mdb_cursor_get(cursor, &mkey, &first, MDB_SET);
+            if(rc == MDB_NOTFOUND) return false;
+            if(rc) lmdb::error::raise("MultiPod seek", rc);
+            return true;
+        }
+
+        // Values under the key the cursor is on
+        static size_t valueCount(MDB_cursor *cursor) {
+            size_t res;
+            const int rc = mdb_cursor_count(cursor, &res);
+            if(rc) lmdb::error::raise("MultiPod COUNT error", rc);
+            return res;
+        }
+
+    public:
+        using key_type = TAllKey;
+
+        static constexpr unsigned int defaultDbiFlags =
+            DbiWrapper::default_dbiflags | MDB_DUPSORT | MDB_DUPFIXED
+            | key_dbiflags<TAllKey>::value | dup_dbiflags<TAllVal>::value;
+
+        explicit MapDB_Pod_MultiPod(const string &dbName) :m_dbiWrap{dbName, defaultDbiFlags} {}
+        explicit MapDB_Pod_MultiPod(DatabaseEnvironment &env, const string &dbName)
+            :m_dbiWrap{env, dbName, defaultDbiFlags} {}
+
+        // Adds val to key's set. Returns false if it was there already.
+        bool put(lmdb::txn &txn, const TAllKey &key, const TAllVal &val) {
+            MDB_val mkey = detail::toMdbVal(key);
+            MDB_val mval = detail::toMdbVal(val);
+            const int rc = mdb_put(txn, m_dbiWrap.handle(txn), &mkey, &mval, MDB_NODUPDATA);
+            if(rc == MDB_KEYEXIST) return false;
+            if(rc) lmdb::error::raise("MultiPod PUT error", rc);
+            return true;
+        }
+
+        // Takes val out of key's set. Returns false if it wasn't there.
+        bool remove(lmdb::txn &txn, const TAllKey &key, const TAllVal &val) {
+            MDB_val mkey = detail::toMdbVal(key);
+            MDB_val mval = detail::toMdbVal(val);
+            const int rc = mdb_del(txn, m_dbiWrap.handle(txn), &mkey, &mval);
+            if(rc == MDB_NOTFOUND) return false;
+            if(rc) lmdb::error::raise("MultiPod REMOVE error", rc);
+            return true;
+        }
+
+        bool contains(lmdb::txn &txn, const TAllKey &key, const TAllVal &val) {
+            auto cursor = openCursor(txn);
+            MDB_val mkey = detail::toMdbVal(key);
+            MDB_val mval = detail::toMdbVal(val);
+            const int rc = mdb_cursor_get(cursor, &mkey, &mval, MDB_GET_BOTH);
+            if(rc == MDB_NOTFOUND) return false;
+            if(rc) lmdb::error::raise("MultiPod CONTAINS error", rc);
+            return true;
+        }
+
+        bool exists(lmdb::txn &txn, const TAllKey &key) {
+            return m_dbiWrap.exists(txn, key);
+        }
+
+        // Removes key and its whole set. Returns false if it had none.
+        bool erase(lmdb::txn &txn, const TAllKey &key) {return m_dbiWrap.del(txn, key);}
+
+        // Removes keys in [lo, hi), sets and all, in one cursor walk; returns how many
+        size_t eraseRange(lmdb::txn &txn, const TAllKey &lo, const TAllKey &hi) {
+            return m_dbiWrap.delRange(txn, lo, hi);
+        }
+
+        // Removes everything (mdb_drop)
+        void clear(lmdb::txn &txn) {m_dbiWrap.clear(txn);}
+
+        // The underlying DB handle, for raw LMDB calls (cursors, mdb_cmp...)
+        MDB_dbi handle(lmdb::txn &txn) {return m_dbiWrap.handle(txn);}
+
+        // Number of values key has (0 if none)
+        size_t count(lmdb::txn &txn, const TAllKey &key) {
+            auto cursor = openCursor(txn);
+            MDB_val first;
+            return seekKey(cursor, key, first) ? valueCount(cursor) : 0;
+        }
+
+        // Calls fn(LmdbSpan<TAllVal>) for each run of key's values, in order,
+        // a page's worth at a time. The spans point into the map.
+        template <typename Fn>
+        void forEachBlock(lmdb::txn &txn, const TAllKey &key, Fn fn) {
+            auto cursor = openCursor(txn);
+            MDB_val mkey, mval;
+            if(! seekKey(cursor, key, mval)) return;
+
+            // LMDB stores a key's only value as a plain node, with no dup
+            // sub-DB for GET_MULTIPLE to read: it'd succeed without setting
+            // mval. So hand over the value MDB_SET gave us instead.
+            if(valueCount(cursor) == 1) {
+                fn(LmdbSpan<unsigned char>{mval}.asSpan<TAllVal>());
+                return;
+            }
+            for(MDB_cursor_op op = MDB_GET_MULTIPLE; ; op = MDB_NEXT_MULTIPLE) {
+                const int rc = mdb_cursor_get(cursor, &mkey, &mval, op);
+                if(rc == MDB_NOTFOUND) return;
+                if(rc) lmdb::error::raise("MultiPod GET MULTIPLE error", rc);
+                fn(LmdbSpan<unsigned char>{mval}.asSpan<TAllVal>());
+            }
+        }
+
+        // Copies out all of key's values (the blocks above, concatenated)
+        std::vector<TAllVal> getAll(lmdb::txn &txn, const TAllKey &key) {
+            std::vector<TAllVal> res;
+            forEachBlock(txn, key, [&res](LmdbSpan<TAllVal> sp) {
+                    res.insert(res.end(), sp.begin(), sp.end()); });
+            return res;
+        }
+
+        // --- Iteration over every (key, value) pair (see CursorRange)
+
+        using Range = CursorRange<TAllKey, detail::PodValAdapt<TAllVal>>;
+
+        Range scan(lmdb::txn &txn, ScanOrder order = ScanOrder::Forward) {
+            return Range::all(txn, m_dbiWrap.handle(txn), order);
+        }
+
+        // Keys in [lo, hi)
+        Range scanRange(lmdb::txn &txn, const TAllKey &lo, const TAllKey &hi,
+                        ScanOrder order = ScanOrder::Forward) {
+            return Range::between(txn, m_dbiWrap.handle(txn), lo, hi, order);
+        }
+
+        // Fast loading of sorted input, sorted by key then value (see BulkLoader)
+        BulkLoader<TAllKey, TAllVal>
+        bulkLoader(DatabaseEnvironment &env, const BulkLoadOptions &opts = BulkLoadOptions{}) {
+            return BulkLoader<TAllKey, TAllVal>{env, m_dbiWrap, opts};
+        }
+    };
+
+
+    // ======================================================================
+    // == MapDB_Indexed_Pod_Pod ===
+    // ==
+    // ==   A MapDB_Pod_Pod that keeps secondary indexes on its values up to
+    // ==   date for you, so you can look records up by (say) owner as well
+    // ==   as by key:
+    // ==
+    // ==       struct Path { uint64_t owner; double length; };
+    // ==       using Paths = MapDB_Indexed_Pod_Pod<uint64_t, Path,
+    // ==                                           LMDBCOLS_FIELD(Path, owner)>;
+    // ==
+    // ==       for(uint64_t id : paths.keysBy<0>(txn, ownerId)) ...
+    // ==
+    // ==   Each index is an extractor type: LMDBCOLS_FIELD for a field of the
+    // ==   value, or your own struct with a `type` and a static
+    // ==   `type of(const TAllVal &)`, for anything computed from it. The
+    // ==   index key type has the same sizeof % 8 rule as other keys.
+    // ==
+    // ==   Index I lives in its own MapDB_Pod_MultiPod (dbName + ".idxI"),
+    // ==   mapping index key to the primary keys having it. put() and erase()
+    // ==   update the indexes in the same txn as the record, so they're
+    // ==   always in step - as long as all writes to the DB go through here.
+    // ==
+    // ==   Takes 1 + number-of-indexes named DBs from your EnvOptions::maxDbs.
+    // ======================================================================
+
+    template <typename TAllKey, typename TAllVal, typename ...Indexes>
+    class MapDB_Indexed_Pod_Pod {
+        static_assert(is_valid_keyval_type<TAllKey>::value, "");
+        static_assert(is_valid_keyval_type<TAllVal>::value, "");
+        static_assert(sizeof...(Indexes) > 0, "MapDB_Indexed_Pod_Pod needs at least one index");
+
+        template <typename Ix> using IndexDb = MapDB_Pod_MultiPod<typename Ix::type, TAllKey>;
+
+        DbiWrapper m_dbiWrap;
+        std::tuple<IndexDb<Indexes>...> m_indexes;
+
+        static string indexName(const string &dbName, size_t i) {
+            return dbName + ".idx" + std::to_string(i);
+        }
+
+        template <size_t I>
+        using IndexAt = typename std::tuple_element<I, std::tuple<Indexes...>>::type;
+
+        // -- Per-index recursion (I counts up through Indexes)
+
+        template <size_t I>
+        typename std::enable_if<I == sizeof...(Indexes)>::type
+        addIndexes(lmdb::txn &, const TAllKey &, const TAllVal &) {}
+
+        template <size_t I>
+        typename std::enable_if<I < sizeof...(Indexes)>::type
+        addIndexes(lmdb::txn &txn, const TAllKey &key, const TAllVal &val) {
+            std::get<I>(m_indexes).put(txn, IndexAt<I>::of(val), key);
+            addIndexes<I + 1>(txn, key, val);
+        }
+
+        template <size_t I>
+        typename std::enable_if<I == sizeof...(Indexes)>::type
+        removeIndexes(lmdb::txn &, const TAllKey &, const TAllVal &) {}
+
+        template <size_t I>
+        typename std::enable_if<I < sizeof...(Indexes)>::type
+        removeIndexes(lmdb::txn &txn, const TAllKey &key, const TAllVal &val) {
+            std::get<I>(m_indexes).remove(txn, IndexAt<I>::of(val), key);
+            removeIndexes<I + 1>(txn, key, val);
+        }
+
+        // Only touches indexes whose key actually changed
+        template <size_t I>
+        typename std::enable_if<I == sizeof...(Indexes)>::type
+        moveIndexes(lmdb::txn &, const TAllKey &, const TAllVal &, const TAllVal &) {}
+
+        template <size_t I>
+        typename std::enable_if<I < sizeof...(Indexes)>::type
+        moveIndexes(lmdb::txn &txn, const TAllKey &key, const TAllVal &oldVal, const TAllVal &newVal) {
+            const typename IndexAt<I>::type oldIx = IndexAt<I>::of(oldVal), newIx = IndexAt<I>::of(newVal);
+            if(memcmp(&oldIx, &newIx, sizeof(oldIx))) {
+                std::get<I>(m_indexes).remove(txn, oldIx, key);
+                std::get<I>(m_indexes).put(txn, newIx, key);
+            }
+            moveIndexes<I + 1>(txn, key, oldVal, newVal);
+        }
+
+    public:
+        using key_type = TAllKey;
+
+        static constexpr unsigned int defaultDbiFlags =
+            DbiWrapper::default_dbiflags | key_dbiflags<TAllKey>::value;
+
+        // The key type of index I
+        template <size_t I>
+        using index_key_type = typename IndexAt<I>::type;
+
+        explicit MapDB_Indexed_Pod_Pod(DatabaseEnvironment &env, const string &dbName)
+            :m_dbiWrap{env, dbName, defaultDbiFlags},
+             m_indexes{ IndexDb<Indexes>{env, indexName(dbName, detail::IndexOf<Indexes, Indexes...>::value)}... } {}
+
+        // Stores val under key, updating each index in the same txn
+        void put(lmdb::txn &txn, const TAllKey &key, const TAllVal &val) {
+            MDB_val mold;
+            if(m_dbiWrap.tryGet(txn, key, mold)) {
+                // Copied, as the put below can move or overwrite it
+                const TAllVal oldVal = LmdbSpan<unsigned char>{mold}.asType<TAllVal>();
+                moveIndexes<0>(txn, key, oldVal, val);
+            } else {
+                addIndexes<0>(txn, key, val);
+            }
+            m_dbiWrap.put(txn, key, val);
+        }
+
+        // Removes key's record and its index entries; false if it wasn't there
+        bool erase(lmdb::txn &txn, const TAllKey &key) {
+            MDB_val mold;
+            if(! m_dbiWrap.tryGet(txn, key, mold)) return false;
+            const TAllVal oldVal = LmdbSpan<unsigned char>{mold}.asType<TAllVal>();
+            removeIndexes<0>(txn, key, oldVal);
+            return m_dbiWrap.del(txn, key);
+        }
+
+        const TAllVal &get(lmdb::txn &txn, const TAllKey &key) {
+            LmdbSpan<unsigned char> sp = m_dbiWrap.get(txn, key);
+            return sp.asType<TAllVal>();
+        }
+
+        bool exists(lmdb::txn &txn, const TAllKey &key) {
+            return m_dbiWrap.exists(txn, key);
+        }
+
+        // The primary DB's handle, for raw LMDB calls (cursors, mdb_cmp...)
+        MDB_dbi handle(lmdb::txn &txn) {return m_dbiWrap.handle(txn);}
+
+        // --- Lookups by index I
+
+        // Number of records whose index I key is ixKey
+        template <size_t I>
+        size_t countBy(lmdb::txn &txn, const index_key_type<I> &ixKey) {
+            return std::get<I>(m_indexes).count(txn, ixKey);
+        }
+
+        // Primary keys of the records whose index I key is ixKey, in key order
+        template <size_t I>
+        std::vector<TAllKey> keysBy(lmdb::txn &txn, const index_key_type<I> &ixKey) {
+            return std::get<I>(m_indexes).getAll(txn, ixKey);
+        }
+
+        // Calls fn(key, value) for each record whose index I key is ixKey
+        template <size_t I, typename Fn>
+        void forEachBy(lmdb::txn &txn, const index_key_type<I> &ixKey, Fn fn) {
+            std::get<I>(m_indexes).forEachBlock(txn, ixKey, [&](LmdbSpan<TAllKey> keys) {
+                    for(const TAllKey &key : keys) fn(key, get(txn, key)); });
+        }
+
+        // Calls fn(ixKey, key, value) for each record whose index I key is in
+        // [lo, hi), in index key order
+        template <size_t I, typename Fn>
+        void forEachInRange(lmdb::txn &txn, const index_key_type<I> &lo,
+                            const index_key_type<I> &hi, Fn fn) {
+            for(auto kv : std::get<I>(m_indexes).scanRange(txn, lo, hi))
+                fn(kv.first, kv.second, get(txn, kv.second));
+        }
+
+        // Primary keys of the records whose index I key is in [lo, hi)
+        template <size_t I>
+        std::vector<TAllKey> keysInRange(lmdb::txn &txn, const index_key_type<I> &lo,
+                                         const index_key_type<I> &hi) {
+            std::vector<TAllKey> res;
+            for(auto kv : std::get<I>(m_indexes).scanRange(txn, lo, hi)) res.push_back(kv.second);
+            return res;
+        }
+
+        // --- Iteration in primary key order (see CursorRange)
+
+        using Range = CursorRange<TAllKey, detail::PodValAdapt<TAllVal>>;
+
+        Range scan(lmdb::txn &txn, ScanOrder order = ScanOrder::Forward) {
+            return Range::all(txn, m_dbiWrap.handle(txn), order);
+        }
+
+        // Keys in [lo, hi)
+        Range scanRange(lmdb::txn &txn, const TAllKey &lo, const TAllKey &hi,
+                        ScanOrder order = ScanOrder::Forward) {
+            return Range::between(txn, m_dbiWrap.handle(txn), lo, hi, order);
+        }
+    };
+
+
+    // ======================================================================
+    // == parallelScan / parallelReduce ===
+    // ==
+    // ==   Scan a whole collection on several threads at once. LMDB readers
+    // ==   don't block each other, so a big scan that's CPU bound on one
+    // ==   core can use all of them.
+    // ==
+    // ==   The key space is cut into threads * chunksPerThread ranges: split
+    // ==   points are interpolated between the first and last keys and then
+    // ==   snapped to real keys with MDB_SET_RANGE seeks. Worker threads each
+    // ==   open their own read txn and take ranges off a shared counter until
+    // ==   none are left, so fast workers pick up the slack from slow ones
+    // ==   (and from uneven key distributions the interpolation misjudges).
+    // ==
+    // ==   Works on any collection with a Range and handle() (MapDB_Pod_Pod,
+    // ==   _PodArray, _PackedArray, _MultiPod). Build the collection against
+    // ==   the env, so its DB handle is resolved up front: opening handles
+    // ==   from concurrent txns isn't allowed by LMDB.
+    // ==
+    // ==   Each worker is its own thread with one read txn, so this works
+    // ==   with or without MDB_NOTLS, and whatever read txns the calling
+    // ==   thread holds. Workers take a reader slot each (see maxreaders).
+    // ==
+    // ==   The workers' txns begin at about the same time but aren't one
+    // ==   snapshot: if a write commits as they start, they can see different
+    // ==   versions. stats.snapshots counts the distinct ones seen.
+    // ======================================================================
+
+    struct ParallelScanOptions {
+        size_t threads         = 0;  // 0 means std::thread::hardware_concurrency()
+        size_t chunksPerThread = 8;  // More evens out skew better, at a seek each
+    };
+
+    struct ParallelScanStats {
+        size_t threads   = 0;
+        size_t chunks    = 0;
+        size_t snapshots = 0;  // Distinct txn ids the workers read at
+        double seconds   = 0;
+    };
+
+    namespace detail {
+        // Where a key sits in key order, as a number we can interpolate over:
+        // the key itself for integer keys, else its first 8 bytes big-endian
+        inline uint64_t keyPosition(const MDB_val &k, bool integerKey) {
+            uint64_t res = 0;
+            if(integerKey) {
+                memcpy(&res, k.mv_data, sizeof(res));
+                return res;
+            }
+            const auto bytes = static_cast<const unsigned char *>(k.mv_data);
+            for(size_t i = 0; i < 8; ++i)
+                res = (res << 8) | (i < k.mv_size ? bytes[i] : 0);
+            return res;
+        }
+
+        inline void keyAtPosition(uint64_t pos, bool integerKey, unsigned char (&out)[8]) {
+            if(integerKey) {
+                memcpy(out, &pos, sizeof(pos));
+                return;
+            }
+            for(size_t i = 0; i < 8; ++i) out[i] = static_cast<unsigned char>(pos >> (56 - 8 * i));
+        }
+
+        // Up to numChunks keys of dbi starting roughly evenly spaced ranges,
+        // in key order; the first is the DB's first key. Empty if the DB is.
+        template <typename TAllKey>
+        std::vector<TAllKey> splitKeys(MDB_txn *txn, MDB_dbi dbi, size_t numChunks) {
+            std::vector<TAllKey> res;
+            unsigned int flags = 0;
+            int rc = mdb_dbi_flags(txn, dbi, &flags);
+            if(rc) lmdb::error::raise("splitKeys flags", rc);
+            const bool integerKey = (flags & MDB_INTEGERKEY) && sizeof(TAllKey) == sizeof(uint64_t);
+
+            auto cursor = lmdb::cursor::open(txn, dbi);
+            MDB_val mkey, mval;
+            auto addKey = [&](const MDB_val &k) {
+                assert( k.mv_size == sizeof(TAllKey) );
+                res.push_back(LmdbSpan<unsigned char>{k}.asType<TAllKey>());
+            };
+
+            rc = mdb_cursor_get(cursor, &mkey, &mval, MDB_FIRST);
+            if(rc == MDB_NOTFOUND) return res;
+            if(rc) lmdb::error::raise("splitKeys first", rc);
+            addKey(mkey);
+            const uint64_t lo = keyPosition(mkey, integerKey);
+            rc = mdb_cursor_get(cursor, &mkey, &mval, MDB_LAST);
+            if(rc) lmdb::error::raise("splitKeys last", rc);
+            const uint64_t hi = keyPosition(mkey, integerKey);
+
+            for(size_t i = 1; hi > lo && i < numChunks; ++i) {
+                unsigned char probe[8];
+                keyAtPosition(lo + static_cast<uint64_t>(
+                                  static_cast<long double>(hi - lo) * i / numChunks),
+                              integerKey, probe);
+                mkey = MDB_val{sizeof(probe), probe};
+                rc = mdb_cursor_get(cursor, &mkey, &mval, MDB_SET_RANGE);
+                if(rc == MDB_NOTFOUND) break;
+                if(rc) lmdb::error::raise("splitKeys seek", rc);
+                addKey(mkey);
+            }
+
+            // Seeks land in key order for memcmp and integer keys; sort anyway
+            // in case of a custom order, and drop repeats from dense stretches
+            auto cmp = [&](const TAllKey &a, const TAllKey &b) {
+                MDB_val ma = detail::toMdbVal(a), mb = detail::toMdbVal(b);
+                return mdb_cmp(txn, dbi, &ma, &mb);
+            };
+            std::sort(res.begin(), res.end(),
+                      [&](const TAllKey &a, const TAllKey &b) {return cmp(a, b) < 0;});
+            res.erase(std::unique(res.begin(), res.end(),
+                                  [&](const TAllKey &a, const TAllKey &b) {return cmp(a, b) == 0;}),
+                      res.end());
+            return res;
+        }
+
+        // Runs chunkFn(chunkIdx, range) for every chunk of db, on worker threads
+        template <typename TDb, typename ChunkFn>
+        ParallelScanStats runParallelChunks(DatabaseEnvironment &env, TDb &db,
+                                            const std::vector<typename TDb::Range::key_type> &bounds,
+                                            size_t threads, ChunkFn chunkFn) {
+            using Range = typename TDb::Range;
+            const auto start = std::chrono::steady_clock::now();
+            const size_t numChunks = bounds.size();
+            threads = std::min(threads, numChunks);
+
+            std::atomic<size_t> nextChunk {0};
+            std::vector<size_t> txnIds (threads);
+            std::vector<std::exception_ptr> errors (threads);
+            std::vector<std::thread> workers;
+            for(size_t t = 0; t < threads; ++t) {
+                workers.emplace_back([&, t] {
+                    try {
+                        auto txn = env.openReadTxn();
+                        txnIds[t] = mdb_txn_id(txn);
+                        const MDB_dbi dbi = db.handle(txn);
+                        for(size_t i; (i = nextChunk.fetch_add(1)) < numChunks; ) {
+                            auto range = i + 1 < numChunks
+                                ? Range::between(txn, dbi, bounds[i], bounds[i + 1], ScanOrder::Forward)
+                                : Range::from(txn, dbi, bounds[i], ScanOrder::Forward);
+                            chunkFn(i, range);
+                        }
+                    }
+                    catch(...) {
+                        errors[t] = std::current_exception();
+                        nextChunk.store(numChunks);  // Stop the others early
+                    }
+                });
+            }
+            for(auto &w : workers) w.join();
+            for(auto &e : errors) if(e) std::rethrow_exception(e);
+
+            ParallelScanStats stats;
+            stats.threads = threads;
+            stats.chunks  = numChunks;
+            std::sort(txnIds.begin(), txnIds.end());
+            stats.snapshots = std::unique(txnIds.begin(), txnIds.end()) - txnIds.begin();
+            stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            return stats;
+        }
+
+        template <typename TDb>
+        std::vector<typename TDb::Range::key_type>
+        splitForParallel(DatabaseEnvironment &env, TDb &db, size_t threads,
+                         const ParallelScanOptions &opts) {
+            auto txn = env.openReadTxn();  // Closed again before the workers start
+            return splitKeys<typename TDb::Range::key_type>(
+                txn, db.handle(txn), threads * std::max<size_t>(1, opts.chunksPerThread));
+        }
+
+        inline size_t parallelThreads(const ParallelScanOptions &opts) {
+            return opts.threads ? opts.threads
+                                : std::max<size_t>(1, std::thread::hardware_concurrency());
+        }
+    }  // namespace detail
+
+    // Calls fn(key, val) for every entry of db - from several threads at once,
+    // and in no particular order, so fn must be thread safe
+    template <typename TDb, typename Fn>
+    ParallelScanStats parallelScan(DatabaseEnvironment &env, TDb &db, Fn fn,
+                                   const ParallelScanOptions &opts = ParallelScanOptions{}) {
+        const size_t threads = detail::parallelThreads(opts);
+        const auto bounds = detail::splitForParallel(env, db, threads, opts);
+        if(bounds.empty()) return ParallelScanStats{};
+        return detail::runParallelChunks(env, db, bounds, threads,
+                                         [&](size_t, typename TDb::Range &range) {
+                                             for(auto kv : range) fn(kv.first, kv.second); });
+    }
+
+    // Folds every entry of db into a TAcc: mapFn(acc, key, val) for each entry,
+    // then mergeFn(acc, const otherAcc) to combine. Each chunk starts from a
+    // copy of init, so it should be an identity (0 for a sum, an empty set...).
+    // Chunks are merged in key order, so the result doesn't depend on thread
+    // timing (floating point sums come out the same every run).
+    template <typename TDb, typename TAcc, typename MapFn, typename MergeFn>
+    TAcc parallelReduce(DatabaseEnvironment &env, TDb &db, const TAcc &init,
+                        MapFn mapFn, MergeFn mergeFn,
+                        const ParallelScanOptions &opts = ParallelScanOptions{},
+                        ParallelScanStats *statsOut = nullptr) {
+        const size_t threads = detail::parallelThreads(opts);
+        const auto bounds = detail::splitForParallel(env, db, threads, opts);
+        if(bounds.empty()) {
+            if(statsOut) *statsOut = ParallelScanStats{};
+            return init;
+        }
+
+        // A cache line each, so threads don't false-share their accumulators
+        // (and so a bool TAcc doesn't land in vector<bool>'s packed bits)
+        struct alignas(64) Slot { TAcc acc; };
+        std::vector<Slot> accs (bounds.size(), Slot{init});
+        const auto stats = detail::runParallelChunks(env, db, bounds, threads,
+                                                     [&](size_t chunk, typename TDb::Range &range) {
+                                                         TAcc &acc = accs[chunk].acc;
+                                                         for(auto kv : range) mapFn(acc, kv.first, kv.second); });
+        if(statsOut) *statsOut = stats;
+
+        TAcc res = std::move(accs[0].acc);
+        for(size_t i = 1; i < accs.size(); ++i) mergeFn(res, static_cast<const TAcc &>(accs[i].acc));
+        return res;
+    }
+
+
+    // ======================================================================
+    // == GroupCommitWriter ===
+    // ==
+    // ==   Write combining for many threads writing to one env. LMDB has one
+    // ==   writer at a time, so threads each doing their own small write txn
+    // ==   queue up behind each other, and each pays for a sync on commit.
+    // ==
+    // ==   Instead, threads submit() their writes here: they go onto a
+    // ==   lock-free queue, and one writer thread drains it, running as many
+    // ==   writes as have built up in one txn (up to maxBatchOps, waiting at
+    // ==   most maxBatchDelay after the first for more to arrive). So
+    // ==   thousands of tiny commits become a few big ones.
+    // ==
+    // ==   Each submit() gets a future, ready once its batch has committed
+    // ==   (i.e. is durable, as far as the env's sync flags make commits so),
+    // ==   or holding the exception if its write failed.
+    // ==
+    // ==   If anything in a batch throws, the whole batch txn is aborted and
+    // ==   its writes are re-run one per txn, so only the bad ones fail. Along
+    // ==   with env.write()'s re-runs on map growth, that means a write may
+    // ==   run more than once, so it should be fine to.
+    // ==
+    // ==   Collections used in writes must outlive them. Destroying the writer
+    // ==   finishes everything already submitted first; submit() from another
+    // ==   thread once destruction has begun throws std::logic_error.
+    // ======================================================================
+
+    struct GroupCommitOptions {
+        size_t maxBatchOps = 1000;
+        std::chrono::microseconds maxBatchDelay {2000};
+    };
+
+    struct GroupCommitStats {
+        size_t ops             = 0;  // Completed, whether they failed or not
+        size_t failedOps       = 0;
+        size_t batches         = 0;  // Commits attempted
+        size_t retriedBatches  = 0;  // Batches that failed and were re-run op by op
+        size_t maxBatchOps     = 0;
+        double commitSeconds   = 0;  // Total time spent running batches
+        double opLatencySeconds = 0;  // Total submit-to-done time over all ops
+        double maxOpLatencySeconds = 0;
+
+        double avgBatchOps()          const {return batches ? double(ops) / batches : 0;}
+        double avgCommitSeconds()     const {return batches ? commitSeconds / batches : 0;}
+        double avgOpLatencySeconds()  const {return ops ? opLatencySeconds / ops : 0;}
+    };
+
+    class GroupCommitWriter {
+        using Clock = std::chrono::steady_clock;
+
+        struct Op {
+            std::function<void(lmdb::txn &)> fn;
+            std::promise<void> done;
+            Clock::time_point enqueued;
+            Op *next = nullptr;
+        };
+
+        DatabaseEnvironment &m_env;
+        const GroupCommitOptions m_opts;
+
+        std::atomic<Op *> m_head {nullptr};  // Treiber stack; newest first
+        std::mutex m_wakeMutex;              // Only for sleeping on, not for the queue
+        std::condition_variable m_wake;
+        std::atomic<bool> m_stopping {false};     // No more submits
+        std::atomic<size_t> m_submitting {0};     // Submits part way through pushing
+        std::atomic<bool> m_writerExit {false};   // Set once those are all in
+
+        mutable std::mutex m_statsMutex;
+        GroupCommitStats m_stats;
+
+        std::thread m_writer;
+
+        // Moves everything queued onto the back of pending, oldest first
+        void drainInto(std::deque<Op *> &pending) {
+            Op *op = m_head.exchange(nullptr, std::memory_order_acquire);
+            const size_t oldSize = pending.size();
+            for(; op; op = op->next) pending.push_back(op);
+            std::reverse(pending.begin() + oldSize, pending.end());
+        }
+
+        bool haveQueued() const {return m_head.load(std::memory_order_acquire) != nullptr;}
+
+        void runBatch(std::deque<Op *> &pending, size_t n) {
+            const auto start = Clock::now();
+            bool batchFailed = false;
+            size_t failed = 0;
+            try {
+                m_env.write([&](lmdb::txn &txn) {
+                        for(size_t i = 0; i < n; ++i) pending[i]->fn(txn); });
+                for(size_t i = 0; i < n; ++i) pending[i]->done.set_value();
+            }
+            catch(...) {
+                batchFailed = true;
+                for(size_t i = 0; i < n; ++i) {
+                    Op *op = pending[i];
+                    try {
+                        m_env.write([op](lmdb::txn &txn) {op->fn(txn);});
+                        op->done.set_value();
+                    }
+                    catch(...) {
+                        ++failed;
+                        op->done.set_exception(std::current_exception());
+                    }
+                }
+            }
+
+            const auto end = Clock::now();
+            std::lock_guard<std::mutex> lock {m_statsMutex};
+            m_stats.ops += n;
+            m_stats.failedOps += failed;
+            m_stats.batches += 1;
+            m_stats.retriedBatches += batchFailed ? 1 : 0;
+            if(n > m_stats.maxBatchOps) m_stats.maxBatchOps = n;
+            m_stats.commitSeconds += std::chrono::duration<double>(end - start).count();
+            for(size_t i = 0; i < n; ++i) {
+                const double lat = std::chrono::duration<double>(end - pending[i]->enqueued).count();
+                m_stats.opLatencySeconds += lat;
+                if(lat > m_stats.maxOpLatencySeconds) m_stats.maxOpLatencySeconds = lat;
+            }
+        }
+
+        void writerLoop() {
+            std::deque<Op *> pending;
+            auto woken = [this] {return haveQueued() || m_writerExit.load();};
+            for(;;) {
+                if(pending.empty()) {
+                    std::unique_lock<std::mutex> lock {m_wakeMutex};
+                    m_wake.wait(lock, woken);
+                }
+                drainInto(pending);
+                if(pending.empty()) {
+                    if(m_writerExit.load()) return;
+                    continue;
+                }
+
+                // Give the batch until its oldest op's deadline to fill up
+                const auto deadline = pending.front()->enqueued + m_opts.maxBatchDelay;
+                while(pending.size() < m_opts.maxBatchOps && ! m_writerExit.load()) {
+                    std::unique_lock<std::mutex> lock {m_wakeMutex};
+                    if(! m_wake.wait_until(lock, deadline, woken)) break;
+                    lock.unlock();
+                    drainInto(pending);
+                }
+
+                const size_t n = pending.size() < m_opts.maxBatchOps ? pending.size() : m_opts.maxBatchOps;
+                runBatch(pending, n);
+                for(size_t i = 0; i < n; ++i) {
+                    delete pending.front();
+                    pending.pop_front();
+                }
+            }
+        }
+
+    public:
+        explicit GroupCommitWriter(DatabaseEnvironment &env,
+                                   const GroupCommitOptions &opts = GroupCommitOptions{})
+            :m_env(env), m_opts(opts)
+        {
+            if(!m_opts.maxBatchOps) throw std::invalid_argument("GroupCommitWriter maxBatchOps must be positive");
+            m_writer = std::thread{[this] {writerLoop();}};
+        }
+
+        ~GroupCommitWriter() {
+            // Turn new submits away, then let those already past the check
+            // finish pushing before telling the writer it can stop once the
+            // queue's empty. (Both seq_cst: a submit either sees m_stopping,
+            // or is counted in m_submitting when we look.)
+            m_stopping.store(true);
+            while(m_submitting.load()) std::this_thread::yield();
+            {
+                std::lock_guard<std::mutex> lock {m_wakeMutex};
+                m_writerExit.store(true);
+            }
+            m_wake.notify_one();
+            m_writer.join();
+
+            // The writer drains everything before it stops, so this is only
+            // a backstop: nothing queued is left with its future unresolved
+            std::deque<Op *> leftover;
+            drainInto(leftover);
+            for(Op *op : leftover) {
+                op->done.set_exception(std::make_exception_ptr(
+                    std::runtime_error("GroupCommitWriter shut down before running op")));
+                delete op;
+            }
+        }
+
+        GroupCommitWriter(const GroupCommitWriter &) = delete;
+        GroupCommitWriter &operator=(const GroupCommitWriter &) = delete;
+
+        // Queues fn(lmdb::txn &) to run in a batch txn on the writer thread
+        std::future<void> submit(std::function<void(lmdb::txn &)> fn) {
+            std::unique_ptr<Op> op {new Op};
+            op->fn = std::move(fn);
+            op->enqueued = Clock::now();
+            auto res = op->done.get_future();
+
+            // Counted while pushing, so the destructor waits for us rather
+            // than letting the writer stop with our op still to land
+            ++m_submitting;
+            struct Done { std::atomic<size_t> &n; ~Done() {--n;} } done {m_submitting};
+            if(m_stopping.load()) throw std::logic_error("GroupCommitWriter submit after shutdown");
+
+            Op *head = m_head.load(std::memory_order_relaxed);
+            do { op->next = head; }
+            while(! m_head.compare_exchange_weak(head, op.get(), std::memory_order_release,
+                                                 std::memory_order_relaxed));
+            op.release();
+            if(! head) {
+                // Queue was empty, so the writer may be asleep; the lock
+                // makes sure it's either waiting or yet to check the queue
+                std::lock_guard<std::mutex> lock {m_wakeMutex};
+                m_wake.notify_one();
+            }
+            return res;
+        }
+
+        // Shorthand for submitting db.put(txn, key, val); copies key and val
+        template <typename TDb, typename K, typename V>
+        std::future<void> put(TDb &db, const K &key, const V &val) {
+            return submit([&db, key, val](lmdb::txn &txn) {db.put(txn, key, val);});
+        }
+
+        GroupCommitStats stats() const {
+            std::lock_guard<std::mutex> lock {m_statsMutex};
+            return m_stats;
+        }
+    };
+
+
+    // ======================================================================
+    // == ReadThroughCache ===
+    // ==
+    // ==   For hot keys where the read does some work on top of the
+    // ==   zero-copy span - decompressing, unpadding, summing - and you don't
+    // ==   want to redo it each time. get(txn, key, compute) hands back the
+    // ==   cached result if it's valid for txn's snapshot, else runs
+    // ==   compute(txn, key) and caches that.
+    // ==
+    // ==   Entries remember the txn id of the snapshot they were computed in,
+    // ==   and are only used by txns that would see the same data. For that
+    // ==   to work, every write txn that changes a cached key must call
+    // ==   invalidate(txn, key) before committing; readers still on older
+    // ==   snapshots keep hitting the old entry. (A txn that aborts after
+    // ==   invalidating just causes some extra misses.) Reads in write txns
+    // ==   always compute, and don't touch the cache.
+    // ==
+    // ==   Memory is bounded by capacity entries, split over lock-striped
+    // ==   shards each with CLOCK eviction. Values are handed out as
+    // ==   shared_ptr<const TValue>, so eviction never pulls one out from
+    // ==   under a reader.
+    // ==
+    // ==   Invalidations of keys not in the cache are kept as tombstones
+    // ==   (so a reader on an older snapshot can't then cache a stale value
+    // ==   as current). Evicting one raises the shard's floor txn id, below
+    // ==   which results aren't cached at all.
+    // ======================================================================
+
+    struct ReadCacheOptions {
+        size_t capacity = 4096;  // Entries, over all shards
+        size_t shards   = 16;
+    };
+
+    struct ReadCacheStats {
+        size_t hits          = 0;
+        size_t misses        = 0;
+        size_t uncached      = 0;  // Misses not kept: old snapshot, or a write txn
+        size_t evictions     = 0;
+        size_t invalidations = 0;
+        size_t entries       = 0;  // Including tombstones
+
+        double hitRate() const {return hits + misses ? double(hits) / (hits + misses) : 0;}
+    };
+
+    namespace detail {
+        // Keys are PODs, so hash and compare them bytewise
+        template <typename T>
+        struct PodBytesHash {
+            size_t operator()(const T &val) const {
+                const unsigned char *bytes = reinterpret_cast<const unsigned char *>(&val);
+                uint64_t hash = 14695981039346656037ULL;  // FNV-1a
+                for(size_t i = 0; i < sizeof(T); ++i) hash = (hash ^ bytes[i]) * 1099511628211ULL;
+                return static_cast<size_t>(hash);
+            }
+        };
+
+        template <typename T>
+        struct PodBytesEqual {
+            bool operator()(const T &a, const T &b) const {return ! memcmp(&a, &b, sizeof(T));}
+        };
+    }
+
+    template <typename TAllKey, typename TValue>
+    class ReadThroughCache {
+        static_assert(std::is_pod<TAllKey>::value, "");
+
+    public:
+        using ValuePtr = std::shared_ptr<const TValue>;
+
+    private:
+        static constexpr uint64_t noTxn = ~uint64_t(0);
+
+        struct Slot {
+            TAllKey key;
+            ValuePtr value;               // Null for tombstones
+            uint64_t snapshot  = 0;       // Txn id value was computed in
+            uint64_t validTo   = noTxn;   // First write after snapshot
+            uint64_t lastWrite = 0;
+            bool referenced    = false;
+            bool used          = false;
+        };
+
+        struct Shard {
+            std::mutex mutex;
+            std::vector<Slot> slots;
+            std::unordered_map<TAllKey, size_t, detail::PodBytesHash<TAllKey>,
+                               detail::PodBytesEqual<TAllKey>> index;
+            size_t hand = 0;
+            uint64_t floor = 0;  // Highest write txn id forgotten by eviction
+            ReadCacheStats stats;
+        };
+
+        std::vector<std::unique_ptr<Shard>> m_shards;
+
+        // A write txn's id is one past the last committed one; a read txn's
+        // is that of the commit it sees
+        static bool isWriteTxn(lmdb::txn &txn) {
+            MDB_envinfo info;
+            const int rc = mdb_env_info(mdb_txn_env(txn), &info);
+            if(rc) lmdb::error::raise("ReadThroughCache ENV INFO error", rc);
+            return mdb_txn_id(txn) > info.me_last_txnid;
+        }
+
+        Shard &shardFor(const TAllKey &key) {
+            return *m_shards[detail::PodBytesHash<TAllKey>{}(key) % m_shards.size()];
+        }
+
+        // Finds key's slot, evicting (CLOCK) to make one if need be. Shard locked.
+        Slot &slotFor(Shard &sh, const TAllKey &key) {
+            auto it = sh.index.find(key);
+            if(it != sh.index.end()) return sh.slots[it->second];
+            for(;;) {
+                Slot &cand = sh.slots[sh.hand];
+                const size_t idx = sh.hand;
+                sh.hand = (sh.hand + 1) % sh.slots.size();
+                if(cand.used && cand.referenced) {
+                    cand.referenced = false;
+                    continue;
+                }
+                if(cand.used) {
+                    if(cand.lastWrite > sh.floor) sh.floor = cand.lastWrite;
+                    sh.index.erase(cand.key);
+                    ++sh.stats.evictions;
+                }
+                cand = Slot{};
+                cand.key = key;
+                cand.used = true;
+                sh.index[key] = idx;
+                return cand;
+            }
+        }
+
+    public:
+        explicit ReadThroughCache(const ReadCacheOptions &opts = ReadCacheOptions{}) {
+            const size_t shards = opts.shards ? opts.shards : 1;
+            const size_t perShard = opts.capacity / shards ? opts.capacity / shards : 1;
+            for(size_t i = 0; i < shards; ++i) {
+                m_shards.emplace_back(new Shard);
+                m_shards.back()->slots.resize(perShard);
+                m_shards.back()->index.reserve(perShard);
+            }
+        }
+
+        // Cached value for key as of txn's snapshot, or null
+        ValuePtr find(lmdb::txn &txn, const TAllKey &key) {
+            const uint64_t snap = mdb_txn_id(txn);
+            Shard &sh = shardFor(key);
+            std::lock_guard<std::mutex> lock {sh.mutex};
+            auto it = sh.index.find(key);
+            if(it != sh.index.end()) {
+                Slot &slot = sh.slots[it->second];
+                if(slot.value && slot.snapshot <= snap && snap < slot.validTo) {
+                    slot.referenced = true;
+                    ++sh.stats.hits;
+                    return slot.value;
+                }
+            }
+            ++sh.stats.misses;
+            return nullptr;
+        }
+
+        // Cached value for key, else compute(txn, key) -> TValue, cached.
+        // In a write txn, always computes: it may see its own uncommitted writes.
+        template <typename Fn>
+        ValuePtr get(lmdb::txn &txn, const TAllKey &key, Fn compute) {
+            if(isWriteTxn(txn)) {
+                ValuePtr res = std::make_shared<const TValue>(compute(txn, key));
+                Shard &sh = shardFor(key);
+                std::lock_guard<std::mutex> lock {sh.mutex};
+                ++sh.stats.misses;
+                ++sh.stats.uncached;
+                return res;
+            }
+            ValuePtr res = find(txn, key);
+            if(res) return res;
+
+            // Computed unlocked; another thread may race us, which is harmless
+            res = std::make_shared<const TValue>(compute(txn, key));
+            const uint64_t snap = mdb_txn_id(txn);
+            Shard &sh = shardFor(key);
+            std::lock_guard<std::mutex> lock {sh.mutex};
+            if(snap < sh.floor) {
+                ++sh.stats.uncached;
+                return res;
+            }
+            Slot &slot = slotFor(sh, key);
+            slot.referenced = true;
+            if(slot.lastWrite > snap) {
+                // Written since this snapshot: res isn't current
+                ++sh.stats.uncached;
+            } else if(! slot.value || slot.snapshot < snap) {
+                slot.value = res;
+                slot.snapshot = snap;
+                slot.validTo = noTxn;
+            }
+            return res;
+        }
+
+        // Call from a write txn that changes key's value, before committing
+        void invalidate(lmdb::txn &writeTxn, const TAllKey &key) {
+            const uint64_t writeId = mdb_txn_id(writeTxn);
+            Shard &sh = shardFor(key);
+            std::lock_guard<std::mutex> lock {sh.mutex};
+            Slot &slot = slotFor(sh, key);
+            if(writeId > slot.lastWrite) slot.lastWrite = writeId;
+            if(slot.value && writeId > slot.snapshot && writeId < slot.validTo)
+                slot.validTo = writeId;
+            ++sh.stats.invalidations;
+        }
+
+        // Evicts everything, tombstones included
+        void clear() {
+            for(auto &sh : m_shards) {
+                std::lock_guard<std::mutex> lock {sh->mutex};
+                for(auto &slot : sh->slots) {
+                    if(slot.used && slot.lastWrite > sh->floor) sh->floor = slot.lastWrite;
+                    slot = Slot{};
+                }
+                sh->index.clear();
+            }
+        }
+
+        ReadCacheStats stats() const {
+            ReadCacheStats res;
+            for(auto &sh : m_shards) {
+                std::lock_guard<std::mutex> lock {sh->mutex};
+                res.hits          += sh->stats.hits;
+                res.misses        += sh->stats.misses;
+                res.uncached      += sh->stats.uncached;
+                res.evictions     += sh->stats.evictions;
+                res.invalidations += sh->stats.invalidations;
+                res.entries       += sh->index.size();
+            }
+            return res;
+        }
+    };
+
+
+    // ======================================================================
+    // == WarmUp ===
+    // ==
+    // ==   Pulls a DB's pages into memory on a background thread, so the
+    // ==   first requests after a restart don't each wait on a page fault
+    // ==   from disk:
+    // ==
+    // ==       auto warm = warmUpDb(env, pathsDB);   // Or warmUpRange,
+    // ==       ...                                   // warmUpKeys, warmUpEnv
+    // ==       while(! warm->done()) report(warm->progress().fraction());
+    // ==
+    // ==   The DB versions walk the records with a cursor, which reads every
+    // ==   leaf page on the way, and madvise(MADV_WILLNEED) any values big
+    // ==   enough to be in overflow pages of their own. warmUpEnv() instead
+    // ==   madvises the whole map a chunk at a time (see adviseMap()).
+    // ==
+    // ==   bytesPerSec caps the rate, so warming up doesn't starve live
+    // ==   traffic of I/O. The read txn is renewed every recordsPerTxn
+    // ==   records, so a long warm-up doesn't pin an old snapshot (or hold
+    // ==   up map growth).
+    // ==
+    // ==   Destroying a WarmUp cancels it and waits for its thread. Errors
+    // ==   come out of wait(). The env and collection must outlive it.
+    // ======================================================================
+
+    struct WarmUpOptions {
+        size_t bytesPerSec   = 0;  // 0 for no limit
+        size_t recordsPerTxn = 100000;
+        size_t envChunkBytes = 4UL * 1024UL * 1024UL;  // Per madvise, for warmUpEnv
+    };
+
+    struct WarmUpProgress {
+        size_t records      = 0;  // Visited so far (none for warmUpEnv)
+        size_t bytes        = 0;  // Read or advised so far
+        size_t totalRecords = 0;  // Expected, if known up front (else 0)
+        size_t totalBytes   = 0;  // Ditto
+        double seconds      = 0;
+        bool   done         = false;
+
+        double fraction() const {
+            if(done) return 1;
+            if(totalRecords) return double(records) / totalRecords;
+            if(totalBytes) return bytes < totalBytes ? double(bytes) / totalBytes : 1;
+            return 0;
+        }
+    };
+
+    class WarmUp {
+        using Clock = std::chrono::steady_clock;
+
+        const WarmUpOptions m_opts;
+        const size_t m_totalRecords, m_totalBytes;
+        const Clock::time_point m_start = Clock::now();
+
+        std::atomic<size_t> m_records {0}, m_bytes {0};
+        std::atomic<bool> m_done {false}, m_cancelled {false};
+        std::atomic<int64_t> m_doneNanos {0};
+        std::exception_ptr m_error;
+
+        std::mutex m_mutex;  // For cancel-aware sleeps
+        std::condition_variable m_cv;
+        std::thread m_thread;
 
     public:
-        explicit MapDB_AutoPadded_Pod_PodArray(const string &dbName) :m_db{dbName} {}
-        explicit MapDB_AutoPadded_Pod_PodArray(const string &dbName, const unsigned int dbiFlags)
-            :m_db{dbName, dbiFlags} {}
-        
-        template <typename Range>
-        void put(lmdb::txn &txn, const TKey &key, const Range &range) {
-            static_assert( std::is_same<
-                               typename std::remove_cv<TValElem>::type,
-                               typename std::remove_cv<typename Range::value_type>::type
-                             >::value,
-                           "Calling array put function with range containing wrong value_type" );
-      
-            std::vector<PadValElem> toPut {};
-            toPut.reserve(range.size());
-            for(auto &o : range) toPut.push_back(PadValElem{o});
-            
-            m_db.put(txn, PadKey{key}, &toPut[0], toPut.size());
+        // Runs fn(WarmUp &) on a new thread; fn reports its work via account()
+        template <typename Fn>
+        explicit WarmUp(const WarmUpOptions &opts, size_t totalRecords, size_t totalBytes, Fn fn)
+            :m_opts(opts), m_totalRecords{totalRecords}, m_totalBytes{totalBytes}
+        {
+            m_thread = std::thread{[this, fn]() mutable {
+                try { fn(*this); }
+                catch(...) { m_error = std::current_exception(); }
+                m_doneNanos = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                  Clock::now() - m_start).count();
+                m_done = true;
+            }};
         }
-        
-        LmdbSpan<PadValElem>
-        get(lmdb::txn &txn, const TKey &key) {
-            return m_db.get(txn, PadKey{key});
+
+        ~WarmUp() {
+            cancel();
+            if(m_thread.joinable()) m_thread.join();
+        }
+
+        WarmUp(const WarmUp &) = delete;
+        WarmUp &operator=(const WarmUp &) = delete;
+
+        const WarmUpOptions &options() const {return m_opts;}
+
+        // For the warming thread: counts work done, then sleeps as long as
+        // the budget needs. Returns false once cancelled.
+        bool account(size_t bytes, size_t records) {
+            const size_t total = m_bytes += bytes;
+            m_records += records;
+            if(m_opts.bytesPerSec) {
+                const auto due = m_start + std::chrono::duration_cast<Clock::duration>(
+                                     std::chrono::duration<double>(double(total) / m_opts.bytesPerSec));
+                std::unique_lock<std::mutex> lock {m_mutex};
+                m_cv.wait_until(lock, due, [this] {return m_cancelled.load();});
+            }
+            return ! m_cancelled;
+        }
+
+        // Stops early, at the next record or chunk
+        void cancel() {
+            {
+                std::lock_guard<std::mutex> lock {m_mutex};
+                m_cancelled = true;
+            }
+            m_cv.notify_all();
+        }
+
+        bool done() const {return m_done;}
+
+        WarmUpProgress progress() const {
+            WarmUpProgress res;
+            res.records      = m_records;
+            res.bytes        = m_bytes;
+            res.totalRecords = m_totalRecords;
+            res.totalBytes   = m_totalBytes;
+            res.done         = m_done;
+            res.seconds      = res.done ? m_doneNanos * 1e-9
+                                        : std::chrono::duration<double>(Clock::now() - m_start).count();
+            return res;
+        }
+
+        // Blocks until finished (or cancelled); rethrows anything it threw
+        WarmUpProgress wait() {
+            if(m_thread.joinable()) m_thread.join();
+            if(m_error) std::rethrow_exception(m_error);
+            return progress();
         }
-        
-        // TODO write exists method
     };
-    
+
+    namespace detail {
+        // Puts cursor on the first record at or after (key, val), for
+        // resuming a walk of a DUPSORT DB: key alone would land back on
+        // key's first value
+        inline int seekDup(lmdb::txn &txn, MDB_dbi dbi, MDB_cursor *cursor,
+                           MDB_val &mkey, MDB_val &mval) {
+            const MDB_val wantKey = mkey;
+            int rc = mdb_cursor_get(cursor, &mkey, &mval, MDB_GET_BOTH_RANGE);
+            if(rc != MDB_NOTFOUND) return rc;
+            // Key's gone, or has nothing at or after val any more
+            mkey = wantKey;
+            rc = mdb_cursor_get(cursor, &mkey, &mval, MDB_SET_RANGE);
+            if(! rc && ! mdb_cmp(txn, dbi, &mkey, &wantKey))
+                rc = mdb_cursor_get(cursor, &mkey, &mval, MDB_NEXT_NODUP);
+            return rc;
+        }
+
+        // Walks db's records from lo (or the start) to before hi (or the
+        // end), renewing the read txn every so often and carrying on from
+        // the next record
+        template <typename TDb>
+        void warmWalk(DatabaseEnvironment &env, TDb &db, WarmUp &warm,
+                      const typename TDb::key_type *lo, const typename TDb::key_type *hi) {
+            using K = typename TDb::key_type;
+            K resumeKey;
+            std::vector<char> resumeVal;  // DUPSORT DBs only
+            bool resuming = false;
+            for(;;) {
+                auto txn = env.openReadTxn();
+                const MDB_dbi dbi = db.handle(txn);
+                unsigned int dbFlags;
+                int rc = mdb_dbi_flags(txn, dbi, &dbFlags);
+                if(rc) lmdb::error::raise("WarmUp dbi flags", rc);
+                const bool dupSort = dbFlags & MDB_DUPSORT;
+
+                auto cursor = lmdb::cursor::open(txn, dbi);
+                MDB_val mkey = detail::toMdbVal(resuming ? &resumeKey : lo, 1);
+                MDB_val mhi  = detail::toMdbVal(hi, 1);
+                MDB_val mval;
+                if(resuming && dupSort) {
+                    mval = detail::toMdbVal(resumeVal.data(), resumeVal.size());
+                    rc = seekDup(txn, dbi, cursor, mkey, mval);
+                } else {
+                    rc = mdb_cursor_get(cursor, &mkey, &mval, (resuming || lo) ? MDB_SET_RANGE : MDB_FIRST);
+                }
+                const size_t perTxn = warm.options().recordsPerTxn;
+                for(size_t inTxn = 0; ! rc; rc = mdb_cursor_get(cursor, &mkey, &mval, MDB_NEXT), ++inTxn) {
+                    if(hi && mdb_cmp(txn, dbi, &mkey, &mhi) >= 0) return;
+                    if(perTxn && inTxn == perTxn) break;
+                    adviseWillNeed(mval, true);
+                    if(! warm.account(mkey.mv_size + mval.mv_size, 1)) return;
+                }
+                if(rc == MDB_NOTFOUND) return;
+                if(rc) lmdb::error::raise("WarmUp cursor walk", rc);
+                memcpy(&resumeKey, mkey.mv_data, sizeof(K));
+                if(dupSort) {
+                    const char *valBytes = static_cast<const char *>(mval.mv_data);
+                    resumeVal.assign(valBytes, valBytes + mval.mv_size);
+                }
+                resuming = true;
+            }
+        }
+
+        // Pages used by db, in bytes
+        inline size_t dbBytes(lmdb::txn &txn, MDB_dbi dbi) {
+            MDB_stat st;
+            const int rc = mdb_stat(txn, dbi, &st);
+            if(rc) lmdb::error::raise("WarmUp DB stat", rc);
+            return (st.ms_branch_pages + st.ms_leaf_pages + st.ms_overflow_pages) * st.ms_psize;
+        }
+    }
+
+    // Every record in db
+    template <typename TDb>
+    std::unique_ptr<WarmUp> warmUpDb(DatabaseEnvironment &env, TDb &db,
+                                     const WarmUpOptions &opts = WarmUpOptions{}) {
+        size_t totalBytes;
+        {
+            auto txn = env.openReadTxn();
+            totalBytes = detail::dbBytes(txn, db.handle(txn));
+        }
+        return std::unique_ptr<WarmUp>{new WarmUp{opts, 0, totalBytes, [&env, &db](WarmUp &warm) {
+                    detail::warmWalk(env, db, warm, nullptr, nullptr); }}};
+    }
+
+    // Records with keys in [lo, hi)
+    template <typename TDb>
+    std::unique_ptr<WarmUp> warmUpRange(DatabaseEnvironment &env, TDb &db,
+                                        const typename TDb::key_type &lo,
+                                        const typename TDb::key_type &hi,
+                                        const WarmUpOptions &opts = WarmUpOptions{}) {
+        return std::unique_ptr<WarmUp>{new WarmUp{opts, 0, 0, [&env, &db, lo, hi](WarmUp &warm) {
+                    detail::warmWalk(env, db, warm, &lo, &hi); }}};
+    }
+
+    // Just the records for keys (e.g. yesterday's hottest); missing ones are skipped
+    template <typename TDb>
+    std::unique_ptr<WarmUp> warmUpKeys(DatabaseEnvironment &env, TDb &db,
+                                       std::vector<typename TDb::key_type> keys,
+                                       const WarmUpOptions &opts = WarmUpOptions{}) {
+        auto shared = std::make_shared<std::vector<typename TDb::key_type>>(std::move(keys));
+        return std::unique_ptr<WarmUp>{new WarmUp{opts, shared->size(), 0,
+                                                  [&env, &db, shared](WarmUp &warm) {
+            const auto &keys = *shared;
+            const size_t perTxn = warm.options().recordsPerTxn ? warm.options().recordsPerTxn : keys.size();
+            for(size_t i = 0; i < keys.size(); ) {
+                auto txn = env.openReadTxn();
+                const MDB_dbi dbi = db.handle(txn);
+                for(size_t inTxn = 0; i < keys.size() && inTxn < perTxn; ++i, ++inTxn) {
+                    MDB_val mkey = detail::toMdbVal(keys[i]);
+                    MDB_val mval {0, nullptr};
+                    const int rc = mdb_get(txn, dbi, &mkey, &mval);
+                    if(rc && rc != MDB_NOTFOUND) lmdb::error::raise("WarmUp key get", rc);
+                    if(! rc) detail::adviseWillNeed(mval, true);
+                    if(! warm.account(mkey.mv_size + mval.mv_size, 1)) return;
+                }
+            }
+        }}};
+    }
+
+    // The whole data file, advised in envChunkBytes pieces; cheaper than a
+    // walk when everything will be wanted, but ignores what's hot
+    inline std::unique_ptr<WarmUp> warmUpEnv(DatabaseEnvironment &env,
+                                             const WarmUpOptions &opts = WarmUpOptions{}) {
+        MDB_envinfo info;
+        MDB_stat st;
+        int rc = mdb_env_info(env.handle(), &info);
+        if(rc) lmdb::error::raise("WarmUp env info", rc);
+        rc = mdb_env_stat(env.handle(), &st);
+        if(rc) lmdb::error::raise("WarmUp env stat", rc);
+        const size_t used = (info.me_last_pgno + 1) * st.ms_psize;
+        const size_t chunk = opts.envChunkBytes ? opts.envChunkBytes : st.ms_psize;
+
+        return std::unique_ptr<WarmUp>{new WarmUp{opts, 0, used, [&env, used, chunk](WarmUp &warm) {
+            for(size_t offset = 0; offset < used; offset += chunk) {
+                const size_t advised = env.adviseMap(MapAdvice::WillNeed, offset, chunk);
+                if(! advised || ! warm.account(advised, 0)) return;
+            }
+        }}};
+    }
+
 
     // ======================================================================
     // == Library self test ===
@@ -495,7 +4907,7 @@ namespace lmdbcols {
 
         // Map db tests
 
-        auto env   = DatabaseEnvironment{testDbPath};
+        auto env   = DatabaseEnvironment{testDbPath, EnvOptions::defaultMaxSize, 32};
         auto mapdb = MapDB_AutoPadded_Pod_Pod<int32_t,char>{"mdb_p_p"};
         
         {
@@ -508,6 +4920,7 @@ namespace lmdbcols {
             auto txn = env.openReadTxn();
             const char &ch = mapdb.get(txn, 123);
             assert( ch == 'a' );
+            assert( mapdb.exists(txn, 123) && ! mapdb.exists(txn, 124) );
             LMDBCOLS_LOG("## Did DB get, same came back");
         }
 
@@ -529,9 +4942,28 @@ namespace lmdbcols {
             auto gotSp = arrdb.get(txn, 22);
             assert( gotSp.size() == 3 );
             assert( *gotSp[1] == 'b' );
+            assert( arrdb.exists(txn, 22) && ! arrdb.exists(txn, 23) );
             LMDBCOLS_LOG("## Did array fetch from DB, and was what we expected");
         }
         
+        // Collections built against the env resolve their handle up front
+        {
+            auto cachedDb = MapDB_AutoPadded_Pod_Pod<int32_t,char>{env, "mdb_p_p"};
+            auto txn = env.openReadTxn();
+            assert( cachedDb.get(txn, 123) == 'a' );
+        }
+
+        // Reading a DB nobody has created yet gives a clean error
+        {
+            auto missingDb = MapDB_Pod_PodArray<uint64_t,double>{"mdb_not_created"};
+            auto txn = env.openReadTxn();
+            bool threw = false;
+            try { missingDb.exists(txn, 1); }
+            catch(const MissingDbError &) { threw = true; }
+            assert( threw );
+            LMDBCOLS_LOG("## Read txn on missing DB threw MissingDbError");
+        }
+        
         // Also test LmdbSpan while we're here
         {
             auto txn = env.openReadTxn();
@@ -541,6 +4973,889 @@ namespace lmdbcols {
             assert( sp1.begin() == sp2.begin() );
             assert( sp1.end() == sp2.end() );
         }
+
+        // PaddedSpan: the values without their padding, and copied out densely
+        {
+            auto longChars = std::vector<char>{};
+            for(int i = 0; i < 37; ++i) longChars.push_back(static_cast<char>('a' + i % 26));
+            auto ints   = std::vector<int32_t>{ -5, 0, 7, 1 << 30, -1, 42, 3 };
+            auto floats = std::vector<float>{ 0.5f, -1.25f, 3.0f, 1e9f, -0.0f, 7.75f };
+            auto intDb   = MapDB_AutoPadded_Pod_PodArray<int32_t, int32_t>{"mdb_p_parr_i32"};
+            auto floatDb = MapDB_AutoPadded_Pod_PodArray<int32_t, float>{"mdb_p_parr_f32"};
+            {
+                auto txn = env.openWriteTxn();
+                arrdb.put(txn, 23, longChars);
+                intDb.put(txn, 1, ints);
+                floatDb.put(txn, 1, floats);
+                txn.commit();
+            }
+
+            auto txn = env.openReadTxn();
+            auto view = arrdb.getView(txn, 22);
+            assert( view.size() == 3 && view[1] == 'b' );
+            assert( std::find(view.begin(), view.end(), 'c') - view.begin() == 2 );
+            assert( view.end() - view.begin() == 3 );
+
+            assert( arrdb.getView(txn, 23).toVector() == longChars );
+            assert( intDb.getView(txn, 1).toVector() == ints );
+            assert( floatDb.getView(txn, 1).toVector() == floats );
+
+            const size_t idxs[] = { 36, 0, 17 };
+            char picked[3];
+            arrdb.getView(txn, 23).gather(idxs, 3, picked);
+            assert( picked[0] == longChars[36] && picked[1] == 'a' && picked[2] == longChars[17] );
+            LMDBCOLS_LOG("## PaddedSpan read and copied out padded arrays");
+        }
+        
+        // Pooled read txns get recycled rather than re-begun
+
+        {
+            { auto txn = env.acquireReadTxn(); assert( mapdb.get(txn, 123) == 'a' ); }
+            { auto txn = env.acquireReadTxn(); assert( mapdb.get(txn, 123) == 'a' ); }
+            const auto stats = env.readTxnPoolStats();
+            assert( stats.misses == 1 && stats.hits == 1 );
+            assert( stats.parked == 1 );
+
+            // Another thread can renew a txn this one parked
+            std::thread{[&] {
+                    auto txn = env.acquireReadTxn();
+                    assert( mapdb.get(txn, 123) == 'a' ); }}.join();
+            const auto after = env.readTxnPoolStats();
+            assert( after.misses == 1 && after.hits == 2 && after.parked == 1 );
+            LMDBCOLS_LOG("## Read txn pool reused its txn, across threads too");
+        }
+
+        // Cursor scans
+        
+        auto scandb = MapDB_Pod_Pod<uint64_t, double>{env, "mdb_scan"};
+
+        {
+            auto txn = env.openWriteTxn();
+            for(uint64_t i = 1; i <= 10; ++i) scandb.put(txn, i, i * 0.5);
+            txn.commit();
+        }
+
+        {
+            auto txn = env.openReadTxn();
+
+            uint64_t expect = 1;
+            for(auto kv : scandb.scan(txn)) {
+                assert( kv.first == expect );
+                assert( kv.second == expect * 0.5 );
+                ++expect;
+            }
+            assert( expect == 11 );
+
+            auto got = std::vector<uint64_t>{};
+            for(auto kv : scandb.scanRange(txn, 3, 7)) got.push_back(kv.first);
+            assert( (got == std::vector<uint64_t>{3, 4, 5, 6}) );
+
+            got.clear();
+            for(auto kv : scandb.scanRange(txn, 3, 7, ScanOrder::Reverse)) got.push_back(kv.first);
+            assert( (got == std::vector<uint64_t>{6, 5, 4, 3}) );
+
+            got.clear();
+            for(auto kv : scandb.scanFrom(txn, 9)) got.push_back(kv.first);
+            assert( (got == std::vector<uint64_t>{9, 10}) );
+            LMDBCOLS_LOG("## Did forward, reverse and range scans");
+        }
+
+        // uint64_t keys get MDB_INTEGERKEY, so scan in numeric order (memcmp
+        // on little-endian bytes would put 256 before 255)
+        {
+            auto intdb = MapDB_Pod_Pod<uint64_t, double>{env, "mdb_intkey"};
+            {
+                auto txn = env.openWriteTxn();
+                for(uint64_t k : {256, 1, 255, 65536}) intdb.put(txn, k, 0.0);
+                txn.commit();
+            }
+            auto txn = env.openReadTxn();
+            auto got = std::vector<uint64_t>{};
+            for(auto kv : intdb.scan(txn)) got.push_back(kv.first);
+            assert( (got == std::vector<uint64_t>{1, 255, 256, 65536}) );
+            LMDBCOLS_LOG("## Integer keys scan in numeric order");
+        }
+
+        // Erasing single keys and ranges, in-place update, and clearing
+
+        {
+            auto erasedb = MapDB_Pod_Pod<uint64_t, double>{env, "mdb_erase"};
+            auto erasemulti = MapDB_Pod_MultiPod<uint64_t, uint64_t>{env, "mdb_erase_multi"};
+            auto padded = MapDB_AutoPadded_Pod_Pod<int32_t, char>{env, "mdb_erase_padded"};
+            {
+                auto txn = env.openWriteTxn();
+                for(uint64_t k = 0; k < 1000; ++k) erasedb.put(txn, k, k * 0.5);
+                for(uint64_t k = 0; k < 10; ++k)
+                    for(uint64_t v = 0; v < 3; ++v) erasemulti.put(txn, k, v);
+                padded.put(txn, 1, 'x');
+                txn.commit();
+            }
+            {
+                auto txn = env.openWriteTxn();
+                const bool erased = erasedb.erase(txn, 5);
+                const bool erasedAgain = erasedb.erase(txn, 5);
+                assert( erased && ! erasedAgain );
+                assert( erasedb.eraseRange(txn, 100, 900) == 800 );
+                assert( erasedb.eraseRange(txn, 100, 900) == 0 );
+                assert( erasemulti.eraseRange(txn, 2, 5) == 3 );
+
+                const bool updated = erasedb.update(txn, 7, [](double &d) {d += 100;});
+                const bool updatedMissing = erasedb.update(txn, 500, [](double &) {assert( false );});
+                assert( updated && ! updatedMissing );
+                padded.update(txn, 1, [](char &c) {c = 'y';});
+                txn.commit();
+            }
+            {
+                auto txn = env.openReadTxn();
+                size_t count = 0;
+                for(auto kv : erasedb.scan(txn)) { (void)kv; ++count; }
+                assert( count == 199 );
+                assert( ! erasedb.exists(txn, 5) && ! erasedb.exists(txn, 100) && erasedb.exists(txn, 900) );
+                assert( erasedb.get(txn, 7) == 103.5 );
+                assert( erasemulti.count(txn, 1) == 3 && erasemulti.count(txn, 2) == 0 );
+                assert( erasemulti.count(txn, 4) == 0 && erasemulti.count(txn, 5) == 3 );
+                assert( padded.get(txn, 1) == 'y' );
+            }
+            {
+                auto txn = env.openWriteTxn();
+                erasedb.clear(txn);
+                txn.commit();
+            }
+            auto txn = env.openReadTxn();
+            assert( ! erasedb.exists(txn, 0) && ! erasedb.exists(txn, 999) );
+            LMDBCOLS_LOG("## Erased keys and ranges, updated in place, cleared");
+        }
+
+        {
+            auto erasecomp = MapDB_Pod_CompressedArray<uint64_t, uint64_t>{env, "mdb_erase_comp"};
+            erasecomp.setMinCompressBytes(0);
+            const auto vals = std::vector<uint64_t>{ 1, 2, 3, 4 };
+            {
+                auto txn = env.openWriteTxn();
+                for(uint64_t k = 0; k < 10; ++k) erasecomp.put(txn, k, vals);
+                const bool erased = erasecomp.erase(txn, 0);
+                const bool erasedAgain = erasecomp.erase(txn, 0);
+                assert( erased && ! erasedAgain );
+                assert( erasecomp.eraseRange(txn, 2, 6) == 4 );
+                txn.commit();
+            }
+            {
+                auto txn = env.openReadTxn();
+                assert( ! erasecomp.exists(txn, 0) && erasecomp.exists(txn, 1) );
+                assert( ! erasecomp.exists(txn, 5) && erasecomp.exists(txn, 6) );
+                assert( erasecomp.get(txn, 6)[3] == 4 );
+            }
+            {
+                auto txn = env.openWriteTxn();
+                erasecomp.clear(txn);
+                txn.commit();
+            }
+            auto txn = env.openReadTxn();
+            assert( ! erasecomp.exists(txn, 1) && ! erasecomp.exists(txn, 9) );
+            LMDBCOLS_LOG("## Erased and cleared compressed arrays");
+        }
+
+        {
+            struct GroupedKey { uint64_t group, id; };
+            auto groupdb = MapDB_Pod_PodArray<GroupedKey, double>{env, "mdb_scan_prefix"};
+            const auto vals = std::vector<double>{ 1.0, 2.0 };
+            {
+                auto txn = env.openWriteTxn();
+                for(uint64_t g = 1; g <= 3; ++g)
+                    for(uint64_t i = 1; i <= 4; ++i)
+                        groupdb.put(txn, GroupedKey{g, i}, &vals[0], vals.size());
+                txn.commit();
+            }
+
+            auto txn = env.openReadTxn();
+            size_t count = 0;
+            for(auto kv : groupdb.scanPrefix(txn, uint64_t{2})) {
+                assert( kv.first.group == 2 );
+                assert( kv.second.size() == 2 && kv.second[1] == 2.0 );
+                ++count;
+            }
+            assert( count == 4 );
+            LMDBCOLS_LOG("## Did prefix scan");
+        }
+        
+        // Batch lookups
+
+        {
+            auto txn = env.openReadTxn();
+            const auto keys = std::vector<uint64_t>{ 7, 99, 2, 7 };
+            std::vector<const double *> out;
+            std::vector<bool> found;
+            const size_t numFound = scandb.getMany(txn, keys, out, found, true);
+            assert( numFound == 3 );
+            assert( found[0] && !found[1] && found[2] && found[3] );
+            assert( *out[0] == 3.5 && out[1] == nullptr && *out[2] == 1.0 && *out[3] == 3.5 );
+            LMDBCOLS_LOG("## Did batch lookup, results in input order");
+        }
+
+        // Bulk loading sorted input
+
+        auto bulkdb = MapDB_Pod_PodArray<uint64_t, double>{env, "mdb_bulk"};
+
+        {
+            auto opts = BulkLoadOptions{};
+            opts.commitEveryRecords = 3;
+            auto loader = bulkdb.bulkLoader(env, opts);
+            const auto vals = std::vector<double>{ 1.0, 2.0, 3.0 };
+            for(uint64_t i = 1; i <= 10; ++i) loader.add(i, &vals[0], vals.size());
+            const BulkLoadStats &stats = loader.finish();
+            assert( stats.records == 10 );
+            assert( stats.commits == 4 );
+        }
+
+        {
+            auto txn = env.openReadTxn();
+            assert( bulkdb.get(txn, 7).size() == 3 );
+            assert( bulkdb.get(txn, 7)[2] == 3.0 );
+        }
+
+        {
+            auto loader = bulkdb.bulkLoader(env);
+            const double val = 1.0;
+            loader.add(20, &val, 1);
+            bool threw = false;
+            try { loader.add(19, &val, 1); }
+            catch(const std::invalid_argument &) { threw = true; }
+            assert( threw );
+            LMDBCOLS_LOG("## Bulk loader rejected out of order key");
+        }
+
+        // Reserved (zero-copy) puts
+
+        {
+            auto txn = env.openWriteTxn();
+            auto dest = bulkdb.reserve(txn, 1000, 4);
+            assert( dest.size() == 4 );
+            for(size_t i = 0; i < dest.size(); ++i) dest[i] = i * 2.0;
+            txn.commit();
+        }
+
+        {
+            auto txn = env.openReadTxn();
+            auto got = bulkdb.get(txn, 1000);
+            assert( got.size() == 4 && got[3] == 6.0 );
+            LMDBCOLS_LOG("## Reserved put came back intact");
+        }
+        
+        // Packed (unpadded) arrays
+
+        {
+            auto packdb = MapDB_Pod_PackedArray<uint64_t, char>{env, "mdb_packed"};
+            auto shortdb = MapDB_Pod_PackedArray<uint64_t, int16_t>{env, "mdb_packed_i16"};
+            const auto chars = std::vector<char>{ 'p','a','c','k','e','d',' ','c','h','a','r','s','!' };
+            const auto shorts = std::vector<int16_t>{ -3, 300, 7 };
+            {
+                auto txn = env.openWriteTxn();
+                packdb.put(txn, 1, chars);
+                packdb.put(txn, 2, std::vector<char>{});
+                shortdb.put(txn, 1, shorts);
+                txn.commit();
+            }
+
+            auto txn = env.openReadTxn();
+            auto got = packdb.get(txn, 1);
+            assert( got.size() == chars.size() );
+            assert( std::equal(got.begin(), got.end(), chars.begin()) );
+            assert( packdb.get(txn, 2).size() == 0 );
+            assert( packdb.exists(txn, 2) && ! packdb.exists(txn, 3) );
+            auto gotShorts = shortdb.get(txn, 1);
+            assert( gotShorts.size() == 3 && gotShorts[0] == -3 && gotShorts[1] == 300 );
+
+            // 8 byte header + 13 chars padded to 16, vs 13 * 8 padded
+            auto raw = DbiWrapper{env, "mdb_packed", packdb.defaultDbiFlags};
+            assert( raw.get(txn, uint64_t{1}).size() == 24 );
+
+            size_t scanned = 0;
+            for(auto kv : packdb.scan(txn)) scanned += kv.second.size();
+            assert( scanned == chars.size() );
+            LMDBCOLS_LOG("## Packed array DB stored elements densely");
+        }
+
+        // Chunked arrays
+
+        {
+            auto copts = ChunkedArrayOptions{};
+            copts.chunkBytes = 10 * sizeof(double);
+            copts.inlineMaxBytes = 8 * sizeof(double);
+            auto chunkdb = MapDB_Pod_ChunkedArray<uint64_t, double>{env, "mdb_chunked", copts};
+            auto seq = [](size_t from, size_t n) {
+                auto res = std::vector<double>{};
+                for(size_t i = from; i < from + n; ++i) res.push_back(double(i));
+                return res;
+            };
+            {
+                auto txn = env.openWriteTxn();
+                chunkdb.put(txn, 1, seq(0, 5));
+                chunkdb.put(txn, 2, seq(0, 95));
+                chunkdb.put(txn, 3, seq(0, 50));
+                chunkdb.put(txn, 3, seq(0, 12));  // Shrinking overwrite drops old chunks
+                chunkdb.put(txn, 4, seq(0, 3));
+                txn.commit();
+            }
+            {
+                auto txn = env.openWriteTxn();
+                chunkdb.append(txn, 2, seq(95, 20).data(), 20);
+                chunkdb.append(txn, 1, seq(5, 10).data(), 10);  // Outgrows inline
+                txn.commit();
+            }
+
+            auto txn = env.openReadTxn();
+            auto small = chunkdb.tryGetContiguous(txn, 1);
+            assert( small.isNull() && chunkdb.size(txn, 1) == 15 );
+            small = chunkdb.tryGetContiguous(txn, 4);
+            assert( small.size() == 3 && small[2] == 2.0 );
+
+            std::vector<double> got;
+            chunkdb.get(txn, 1, got);
+            assert( got == seq(0, 15) );
+            chunkdb.get(txn, 2, got);
+            assert( got == seq(0, 115) );
+            chunkdb.get(txn, 3, got);
+            assert( got == seq(0, 12) );
+
+            size_t spans = 0;
+            chunkdb.forEachSpan(txn, 2, 17, 30, [&](LmdbSpan<double> sp) {(void)sp; ++spans;});
+            assert( spans == 4 );  // Elements 17..46 are in chunks 1..4
+            chunkdb.getRange(txn, 2, 17, 30, got);
+            assert( got == seq(17, 30) );
+
+            bool threw = false;
+            try { chunkdb.getRange(txn, 2, 100, 16, got); }
+            catch(const std::out_of_range &) { threw = true; }
+            assert( threw );
+            LMDBCOLS_LOG("## Chunked array DB read ranges and appended");
+        }
+
+        // Compressed arrays
+
+        {
+            struct TestPos { double lat, lon; uint64_t time; };
+            auto compdb = MapDB_Pod_CompressedArray<uint64_t, TestPos>{env, "mdb_compressed"};
+            auto track = std::vector<TestPos>{};
+            for(uint64_t i = 0; i < 1000; ++i)
+                track.push_back(TestPos{ 51.5 + i * 1e-5, -0.12 - i * 2e-5, 1500000000 + i * 5 });
+            const auto shortTrack = std::vector<TestPos>(track.begin(), track.begin() + 3);
+            {
+                auto txn = env.openWriteTxn();
+                compdb.put(txn, 1, track);
+                compdb.put(txn, 2, shortTrack);
+                txn.commit();
+            }
+
+            auto sameAs = [](LmdbSpan<TestPos> sp, const std::vector<TestPos> &v) {
+                return sp.size() == v.size()
+                    && (v.empty() || !memcmp(sp.begin(), v.data(), v.size() * sizeof(TestPos)));
+            };
+            auto txn = env.openReadTxn();
+            CompressionArena arena;
+            auto got1 = compdb.get(txn, 1, arena);
+            auto got2 = compdb.get(txn, 2, arena);
+            assert( sameAs(got1, track) && sameAs(got2, shortTrack) );
+            assert( sameAs(compdb.get(txn, 1), track) );
+
+            size_t seen = 0;
+            compdb.forEach(txn, [&](const uint64_t &, LmdbSpan<TestPos> sp) {seen += sp.size();});
+            assert( seen == track.size() + shortTrack.size() );
+
+            const auto stats = compdb.stats();
+            assert( stats.valuesCompressed == 1 && stats.valuesRaw == 1 );
+            assert( stats.ratio() > 2 );
+            LMDBCOLS_LOG("## Compressed array DB round-tripped; ratio", stats.ratio());
+        }
+
+        // Columnar storage
+
+        {
+            struct Trade { uint64_t time; double price; int32_t qty; char side; };
+            using Trades = ColumnarDB<uint64_t, Trade,
+                                      LMDBCOLS_FIELD(Trade, price),
+                                      LMDBCOLS_FIELD(Trade, qty),
+                                      LMDBCOLS_FIELD(Trade, side)>;
+            auto trades = Trades{env, "mdb_columnar", 4};
+            {
+                auto txn = env.openWriteTxn();
+                auto app = trades.appender(txn);
+                for(uint64_t i = 0; i < 10; ++i)
+                    app.add(i * 10, Trade{ i * 10, 100.0 + i, int32_t(i), i % 2 ? 'b' : 's' });
+                app.finish();
+                txn.commit();
+            }
+            {
+                auto txn = env.openWriteTxn();
+                auto app = trades.appender(txn);
+                bool threw = false;
+                try { app.add(90, Trade{}); }
+                catch(const std::invalid_argument &) { threw = true; }
+                assert( threw );
+                app.add(100, Trade{ 100, 110.0, 10, 's' });
+                app.finish();
+                txn.commit();
+            }
+
+            auto txn = env.openReadTxn();
+            double total = 0;
+            size_t blocks = 0, rows = 0;
+            for(auto blk : trades.column<0>(txn)) {
+                ++blocks;
+                rows += blk.second.size();
+                for(double p : blk.second) total += p;
+            }
+            assert( blocks == 4 && rows == 11 );
+            assert( total == 100.0 * 11 + 55 );
+
+            Trade got {};
+            const bool found = trades.get(txn, 70, got);
+            assert( found && got.price == 107.0 && got.qty == 7 && got.side == 'b' );
+            assert( got.time == 0 );  // Not a stored field
+            assert( ! trades.get(txn, 75, got) && ! trades.get(txn, 5000, got) );
+            assert( trades.get(txn, 100, got) && got.qty == 10 );
+            LMDBCOLS_LOG("## Columnar DB scanned a column and reassembled records");
+        }
+
+        // Parallel scans
+
+        {
+            auto pardb = MapDB_Pod_Pod<uint64_t, double>{env, "mdb_parallel"};
+            auto opts = ParallelScanOptions{};
+            opts.threads = 4;
+            assert( parallelReduce(env, pardb, 0.0,
+                                   [](double &acc, const uint64_t &, const double &v) {acc += v;},
+                                   [](double &acc, const double &o) {acc += o;}, opts) == 0.0 );
+            {
+                auto txn = env.openWriteTxn();
+                for(uint64_t i = 0; i < 1000; ++i) pardb.put(txn, i * i, double(i));  // Skewed keys
+                txn.commit();
+            }
+
+            ParallelScanStats stats;
+            const double sum = parallelReduce(env, pardb, 0.0,
+                                              [](double &acc, const uint64_t &, const double &v) {acc += v;},
+                                              [](double &acc, const double &o) {acc += o;},
+                                              opts, &stats);
+            assert( sum == 999.0 * 1000 / 2 );
+            assert( stats.threads == 4 && stats.chunks > 1 && stats.snapshots == 1 );
+            assert( parallelReduce(env, pardb, false,
+                                   [](bool &acc, const uint64_t &, const double &v) {acc = acc || v == 999.0;},
+                                   [](bool &acc, const bool &o) {acc = acc || o;}, opts) );
+
+            std::atomic<size_t> seen {0};
+            parallelScan(env, pardb, [&](const uint64_t &, const double &) {++seen;}, opts);
+            assert( seen == 1000 );
+            LMDBCOLS_LOG("## Parallel reduce matched serial sum over", stats.chunks, "chunks");
+        }
+
+        // Group commit
+
+        {
+            auto gcdb = MapDB_Pod_Pod<uint64_t, double>{env, "mdb_group_commit"};
+            GroupCommitStats stats;
+            {
+                GroupCommitWriter writer {env};
+                std::vector<std::thread> producers;
+                std::vector<std::vector<std::future<void>>> futures (4);
+                for(size_t t = 0; t < 4; ++t) {
+                    producers.emplace_back([&, t] {
+                        for(uint64_t i = 0; i < 250; ++i)
+                            futures[t].push_back(writer.put(gcdb, t * 1000 + i, double(i)));
+                    });
+                }
+                for(auto &p : producers) p.join();
+                for(auto &fs : futures) for(auto &f : fs) f.get();
+
+                auto bad = writer.submit([](lmdb::txn &) {throw std::runtime_error("bad write");});
+                auto good = writer.put(gcdb, 99999, 1.0);
+                bool threw = false;
+                try { bad.get(); }
+                catch(const std::runtime_error &) { threw = true; }
+                assert( threw );
+                good.get();
+                stats = writer.stats();
+            }
+
+            assert( stats.ops == 1002 && stats.failedOps == 1 );
+            assert( stats.batches >= 1 && stats.batches <= 1002 );
+            size_t count = 0;
+            auto txn = env.openReadTxn();
+            for(auto kv : gcdb.scan(txn)) { (void)kv; ++count; }
+            assert( count == 1001 );
+            LMDBCOLS_LOG("## Group commit wrote 1001 values in", stats.batches, "batches");
+        }
+
+        // Secondary indexes kept up to date on put / erase
+
+        {
+            struct Owned { uint64_t owner; double length; };
+            struct LengthBucket {
+                using type = uint64_t;
+                static type of(const Owned &o) {return static_cast<uint64_t>(o.length / 10);}
+            };
+            using Indexed = MapDB_Indexed_Pod_Pod<uint64_t, Owned, LMDBCOLS_FIELD(Owned, owner), LengthBucket>;
+            auto idxdb = Indexed{env, "mdb_indexed"};
+            {
+                auto txn = env.openWriteTxn();
+                for(uint64_t i = 0; i < 100; ++i) idxdb.put(txn, i, Owned{i % 7, double(i)});
+                idxdb.put(txn, 3, Owned{6, 3.0});  // Moves key 3 from owner 3 to owner 6
+                idxdb.put(txn, 200, Owned{100, 5.0});  // Owners with a single record
+                idxdb.put(txn, 201, Owned{101, 5.0});
+                idxdb.put(txn, 201, Owned{102, 5.0});
+                const bool erased = idxdb.erase(txn, 10);
+                const bool erasedAgain = idxdb.erase(txn, 10);
+                assert( erased && ! erasedAgain );
+                txn.commit();
+            }
+
+            auto txn = env.openReadTxn();
+            assert( idxdb.countBy<0>(txn, 3) == 12 );  // 14 of 0..99, less 3 (moved) and 10 (erased)
+            assert( (idxdb.keysBy<0>(txn, 6) == std::vector<uint64_t>{3, 6, 13, 20, 27, 34, 41, 48,
+                                                                        55, 62, 69, 76, 83, 90, 97}) );
+            size_t lengthSum = 0;
+            idxdb.forEachBy<0>(txn, 6, [&](uint64_t key, const Owned &o) {
+                    assert( o.owner == 6 && o.length == double(key) ); lengthSum += key; });
+            assert( lengthSum == 3 + 6 + 13 + 20 + 27 + 34 + 41 + 48 + 55 + 62 + 69 + 76 + 83 + 90 + 97 );
+
+            assert( idxdb.countBy<0>(txn, 100) == 1 );
+            assert( (idxdb.keysBy<0>(txn, 100) == std::vector<uint64_t>{200}) );
+            size_t singleSeen = 0;
+            idxdb.forEachBy<0>(txn, 100, [&](uint64_t key, const Owned &o) {
+                    assert( key == 200 && o.owner == 100 ); ++singleSeen; });
+            assert( singleSeen == 1 );
+            assert( idxdb.keysBy<0>(txn, 101).empty() );
+            assert( (idxdb.keysBy<0>(txn, 102) == std::vector<uint64_t>{201}) );
+
+            // Lengths 10..29, less the erased 10
+            assert( idxdb.keysInRange<1>(txn, 1, 3).size() == 19 );
+            size_t inRange = 0;
+            idxdb.forEachInRange<1>(txn, 9, 100, [&](uint64_t bucket, uint64_t key, const Owned &o) {
+                    assert( bucket == 9 && o.length == double(key) ); ++inRange; });
+            assert( inRange == 10 );
+            assert( ! idxdb.exists(txn, 10) && idxdb.countBy<1>(txn, 1) == 9 );
+            LMDBCOLS_LOG("## Indexed DB kept its secondary indexes in step");
+        }
+
+        // Read-through cache
+
+        {
+            auto sumdb = MapDB_Pod_PodArray<uint64_t, double>{env, "mdb_cached"};
+            auto cache = ReadThroughCache<uint64_t, double>{};
+            size_t computed = 0;
+            auto sumOf = [&](lmdb::txn &txn, uint64_t key) {
+                ++computed;
+                double res = 0;
+                for(double d : sumdb.get(txn, key)) res += d;
+                return res;
+            };
+            {
+                auto txn = env.openWriteTxn();
+                const double vals[] = {1, 2, 3};
+                sumdb.put(txn, 1, vals, 3);
+                txn.commit();
+            }
+
+            auto oldTxn = env.openReadTxn();
+            assert( *cache.get(oldTxn, 1, sumOf) == 6 );
+            assert( *cache.get(oldTxn, 1, sumOf) == 6 && computed == 1 );
+
+            {
+                auto txn = env.openWriteTxn();
+                const double vals[] = {10, 20};
+                sumdb.put(txn, 1, vals, 2);
+                cache.invalidate(txn, 1);
+                assert( *cache.get(txn, 1, sumOf) == 30 );  // Write txns always compute
+                txn.commit();
+            }
+            assert( *cache.get(oldTxn, 1, sumOf) == 6 && computed == 2 );  // Old snapshot still hits
+            oldTxn.abort();
+
+            {
+                auto txn = env.openReadTxn();
+                assert( *cache.get(txn, 1, sumOf) == 30 );
+                assert( *cache.get(txn, 1, sumOf) == 30 && computed == 3 );
+            }
+            auto stats = cache.stats();
+            assert( stats.hits == 3 && stats.misses == 3 && stats.invalidations == 1 );
+
+            auto opts = ReadCacheOptions{};
+            opts.capacity = 4;
+            opts.shards = 1;
+            auto small = ReadThroughCache<uint64_t, double>{opts};
+            auto txn = env.openReadTxn();
+            for(uint64_t i = 0; i < 10; ++i) small.get(txn, i, [](lmdb::txn &, uint64_t k) {return double(k);});
+            assert( *small.get(txn, 9, sumOf) == 9 );
+            stats = small.stats();
+            assert( stats.entries == 4 && stats.evictions == 6 && stats.hits == 1 );
+            LMDBCOLS_LOG("## Read-through cache followed snapshots, hit rate", cache.stats().hitRate());
+        }
+
+        // One-to-many (DUPSORT) collection
+
+        {
+            auto multidb = MapDB_Pod_MultiPod<uint64_t, uint64_t>{env, "mdb_multi"};
+            {
+                auto txn = env.openWriteTxn();
+                for(uint64_t v : {30, 10, 20, 1000}) multidb.put(txn, 5, v);
+                multidb.put(txn, 7, 42);  // A lone value is stored differently
+                const bool putDup = multidb.put(txn, 5, 20);
+                assert( ! putDup );
+                const bool removed = multidb.remove(txn, 5, 1000);
+                const bool removedAgain = multidb.remove(txn, 5, 1000);
+                assert( removed && ! removedAgain );
+                txn.commit();
+            }
+
+            auto txn = env.openReadTxn();
+            assert( multidb.count(txn, 5) == 3 );
+            assert( multidb.count(txn, 6) == 0 );
+            assert( multidb.contains(txn, 5, 20) && ! multidb.contains(txn, 5, 25) );
+            assert( (multidb.getAll(txn, 5) == std::vector<uint64_t>{10, 20, 30}) );
+            assert( multidb.count(txn, 7) == 1 );
+            assert( (multidb.getAll(txn, 7) == std::vector<uint64_t>{42}) );
+            LMDBCOLS_LOG("## Multi-value DB kept a sorted set per key");
+        }
+
+        {
+            auto bulkmulti = MapDB_Pod_MultiPod<uint64_t, uint64_t>{env, "mdb_bulk_multi"};
+            {
+                auto opts = BulkLoadOptions{};
+                opts.commitEveryRecords = 4;  // Batches split some keys' sets
+                auto loader = bulkmulti.bulkLoader(env, opts);
+                for(uint64_t k = 1; k <= 5; ++k)
+                    for(uint64_t v = 1; v <= 3; ++v) loader.add(k, k * 10 + v);
+                assert( loader.finish().records == 15 );
+            }
+
+            {
+                auto txn = env.openReadTxn();
+                assert( bulkmulti.count(txn, 3) == 3 );
+                assert( (bulkmulti.getAll(txn, 2) == std::vector<uint64_t>{21, 22, 23}) );
+                assert( (bulkmulti.getAll(txn, 5) == std::vector<uint64_t>{51, 52, 53}) );
+            }
+
+            {
+                auto loader = bulkmulti.bulkLoader(env);
+                loader.add(10, 5);
+                bool threw = false;
+                try { loader.add(10, 4); }
+                catch(const std::invalid_argument &) { threw = true; }
+                assert( threw );
+            }
+            LMDBCOLS_LOG("## Bulk loaded multi-value DB, rejected out of order dup");
+        }
+        
+        // Env / per DB stats, and op metrics if compiled in
+
+        {
+            const auto stats = env.stats();
+            assert( stats.mapSize >= EnvOptions::defaultMaxSize );
+            assert( stats.activeReaders == 0 );
+            bool sawPackedDb = false;
+            for(auto &d : stats.dbs) {
+                if(d.name != "mdb_packed") continue;
+                sawPackedDb = true;
+                assert( d.entries == 2 && d.depth >= 1 && d.leafPages >= 1 );
+            }
+            assert( sawPackedDb );
+
+            // A reader left open while a write commits lags by one txn (it's on
+            // another thread, as stats() needs a read txn of its own)
+            auto metricsDb = MapDB_Pod_Pod<uint64_t, double>{env, "mdb_parallel"};
+            {
+                std::promise<void> opened, release;
+                std::thread reader {[&] {
+                        auto txn = env.openReadTxn();
+                        assert( metricsDb.get(txn, 4) == 2.0 );
+                        opened.set_value();
+                        release.get_future().wait(); }};
+                opened.get_future().wait();
+                {
+                    auto txn = env.openWriteTxn();
+                    metricsDb.put(txn, 4, 2.0);
+                    txn.commit();
+                }
+                const auto withReader = env.stats();
+                release.set_value();
+                reader.join();
+                assert( withReader.activeReaders == 1 && withReader.oldestReaderLag == 1 );
+            }
+#ifdef LMDBCOLS_ENABLE_METRICS
+            assert( stats.metricsEnabled );
+            const auto ops = env.stats();
+            for(auto &d : ops.dbs) {
+                if(d.name != "mdb_parallel") continue;
+                assert( d.ops.puts >= 1000 && d.ops.gets >= 1 );
+                assert( d.ops.getLatency.count() == d.ops.gets );
+            }
+            assert( ops.writeTxnLatency.count() > 0 );
+#endif
+            assert( stats.dbsUnlisted == 0 );
+            LMDBCOLS_LOG("## Env stats listed", stats.dbs.size(), "named DBs");
+        }
+
+        {
+            // Three DBs in a file reopened with handles for only one
+            {
+                auto fullEnv = DatabaseEnvironment{testDbPath + "-fewdbs", EnvOptions::defaultMaxSize, 3};
+                for(auto name : {"a", "b", "c"}) MapDB_Pod_Pod<uint64_t, double>{fullEnv, name};
+            }
+            auto fewEnv = DatabaseEnvironment{testDbPath + "-fewdbs", EnvOptions::defaultMaxSize, 1};
+            const auto stats = fewEnv.stats();
+            assert( stats.dbs.size() == 1 && stats.dbsUnlisted == 2 );
+
+            LatencyHistogramSnapshot hist;
+            hist.buckets[LatencyHistogramSnapshot::numBuckets - 1] = 1;
+            assert( hist.percentileNanos(0.5) == static_cast<double>(UINT64_MAX) );
+            LMDBCOLS_LOG("## Env stats reported DBs it had no handles for");
+        }
+
+        // Async durability modes, with explicit and scheduled syncs
+
+        {
+            auto opts = EnvOptions{};
+            opts.noSync = true;
+            opts.noMetaSync = true;
+            opts.syncInterval = std::chrono::milliseconds{5};
+            auto asyncEnv = DatabaseEnvironment{testDbPath + "-nosync", opts};
+            auto asyncDb  = MapDB_Pod_Pod<uint64_t, double>{asyncEnv, "mdb_nosync"};
+            {
+                auto txn = asyncEnv.openWriteTxn();
+                asyncDb.put(txn, 1, 2.5);
+                txn.commit();
+            }
+            asyncEnv.sync();
+            std::this_thread::sleep_for(std::chrono::milliseconds{50});
+            assert( asyncEnv.backgroundSyncs() > 0 && asyncEnv.backgroundSyncFailures() == 0 );
+
+            auto txn = asyncEnv.openReadTxn();
+            assert( asyncDb.get(txn, 1) == 2.5 );
+            LMDBCOLS_LOG("## NOSYNC env synced explicitly and in the background");
+        }
+
+        // Background warm-up, and map access hints
+
+        {
+            auto warmdb = MapDB_Pod_Pod<uint64_t, double>{env, "mdb_warm"};
+            {
+                auto txn = env.openWriteTxn();
+                for(uint64_t i = 0; i < 1000; ++i) warmdb.put(txn, i, i * 0.5);
+                txn.commit();
+            }
+
+            auto wopts = WarmUpOptions{};
+            wopts.recordsPerTxn = 7;  // Lots of txn renewals and resumes
+            auto all = warmUpDb(env, warmdb, wopts);
+            auto range = warmUpRange(env, warmdb, 10, 20, wopts);
+            auto keys = warmUpKeys(env, warmdb, std::vector<uint64_t>{3, 5000, 999}, wopts);
+            auto whole = warmUpEnv(env, wopts);
+
+            const auto allDone = all->wait();
+            assert( allDone.done && allDone.records == 1000 && allDone.fraction() == 1 );
+            assert( allDone.bytes == 1000 * 16 && allDone.totalBytes > 0 );
+            assert( range->wait().records == 10 );
+            assert( keys->wait().records == 3 && keys->progress().totalRecords == 3 );
+
+            // Resuming mid-way through a key's values carries on from the value
+            auto warmMulti = MapDB_Pod_MultiPod<uint64_t, uint64_t>{env, "mdb_warm_multi"};
+            {
+                auto txn = env.openWriteTxn();
+                for(uint64_t k = 0; k < 3; ++k)
+                    for(uint64_t v = 0; v < 20; ++v) warmMulti.put(txn, k, v);
+                txn.commit();
+            }
+            assert( warmUpDb(env, warmMulti, wopts)->wait().records == 60 );
+            assert( warmUpRange(env, warmMulti, 1, 2, wopts)->wait().records == 20 );
+            const auto wholeDone = whole->wait();
+#ifdef LMDBCOLS_HAVE_MADVISE
+            assert( wholeDone.bytes == wholeDone.totalBytes && wholeDone.bytes > 0 );
+#endif
+
+            wopts.bytesPerSec = 16;  // A record a second: only gets a little way
+            auto slow = warmUpDb(env, warmdb, wopts);
+            std::this_thread::sleep_for(std::chrono::milliseconds{20});
+            slow->cancel();
+            assert( slow->wait().records < 10 );
+
+#ifdef LMDBCOLS_HAVE_MADVISE
+            assert( env.adviseMap(MapAdvice::Random) > 0 );
+            assert( env.adviseMap(MapAdvice::Normal) > 0 );
+#endif
+            LMDBCOLS_LOG("## Warmed up DB, range, keys and env,", wholeDone.bytes, "bytes advised");
+        }
+
+        // Whole env snapshot, and flat dump / load of single collections
+
+        {
+            auto srcdb = MapDB_Pod_Pod<uint64_t, double>{env, "mdb_flat_src"};
+            auto srcMulti = MapDB_Pod_MultiPod<uint64_t, uint64_t>{env, "mdb_flat_multi_src"};
+            {
+                auto txn = env.openWriteTxn();
+                for(uint64_t i = 0; i < 1000; ++i) srcdb.put(txn, i * 3, i * 0.5);
+                for(uint64_t v : {7, 3, 5}) srcMulti.put(txn, 1, v);
+                srcMulti.put(txn, 2, 9);
+                txn.commit();
+            }
+
+            std::stringstream flat, flatMulti;
+            {
+                auto txn = env.openReadTxn();
+                const auto dumped = dumpFlat(txn, srcdb, flat);
+                assert( dumped.records == 1000 );
+                assert( dumped.bytes == 6 * 8 + 1000 * 4 * 8 && size_t(flat.tellp()) == dumped.bytes );
+                assert( dumpFlat(txn, srcMulti, flatMulti).records == 4 );
+            }
+
+            auto dstdb = MapDB_Pod_Pod<uint64_t, double>{env, "mdb_flat_dst"};
+            auto dstMulti = MapDB_Pod_MultiPod<uint64_t, uint64_t>{env, "mdb_flat_multi_dst"};
+            auto lopts = BulkLoadOptions{};
+            lopts.commitEveryRecords = 300;
+            const auto loaded = loadFlat(env, dstdb, flat, lopts);
+            assert( loaded.records == 1000 );
+            loadFlat(env, dstMulti, flatMulti);
+
+            auto snap = env.snapshotTo(testDbPath + "-snapshot", true);
+            assert( snap.bytes > 0 );
+            {
+                auto txn = env.openReadTxn();
+                assert( dstdb.get(txn, 999 * 3) == 999 * 0.5 );
+                assert( (dstMulti.getAll(txn, 1) == std::vector<uint64_t>{3, 5, 7}) );
+                assert( dstMulti.count(txn, 2) == 1 );
+            }
+
+            std::stringstream junk {"not a dump at all"};
+            bool threw = false;
+            try { loadFlat(env, dstdb, junk); }
+            catch(const std::runtime_error &) { threw = true; }
+            assert( threw );
+
+            auto snapEnv = DatabaseEnvironment{testDbPath + "-snapshot", EnvOptions::defaultMaxSize, 32};
+            auto snapdb  = MapDB_Pod_Pod<uint64_t, double>{snapEnv, "mdb_flat_dst"};
+            auto txn = snapEnv.openReadTxn();
+            assert( snapdb.get(txn, 3) == 0.5 );
+            LMDBCOLS_LOG("## Flat dump/load and compacted env snapshot,", snap.bytes, "bytes");
+        }
+
+        // Map growth: a small map that fills up gets bigger rather than failing
+
+        {
+            auto opts = EnvOptions{};
+            opts.maxSize = 256UL * 1024UL;
+            opts.growthFactor = 2;
+            opts.maxGrowSize = 64UL * 1024UL * 1024UL;
+            auto growEnv = DatabaseEnvironment{testDbPath + "-grow", opts};
+            auto growDb  = MapDB_Pod_PodArray<uint64_t, double>{growEnv, "mdb_grow"};
+
+            const auto vals = std::vector<double>(1024, 1.0);
+            growEnv.write([&](lmdb::txn &txn) {
+                    for(uint64_t i = 0; i < 256; ++i) growDb.put(txn, i, &vals[0], vals.size()); });
+            assert( growEnv.mapGrowths() > 0 );
+            assert( growEnv.mapSize() > opts.maxSize );
+
+            auto txn = growEnv.openReadTxn();
+            assert( growDb.get(txn, 255).size() == 1024 );
+            LMDBCOLS_LOG("## Map grew to fit the write");
+        }
         
         LMDBCOLS_LOG("lmdbcols self test completed successfully");
     }
@@ -0,0 +1,695 @@
+// Microbenchmarks for lmdbcols library
+//
+// Prints results to stdout as JSON: one entry per benchmark, with throughput
+// and (where ops are timed individually) p50/p99 latency in nanoseconds.
+// Progress goes to stderr.
+//
+// Runs are reproducible: fixed op counts and fixed random seeds.
+//
+// Creates a new scratch LMDB DB file to run against.
+// Provide name/path to this as the first and only cli argument.
+// Bails if a file already exists here.
+
+// Copyright (c) Inkblot Software Limited 2017
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#include <string>
+#include <iostream>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include <random>
+#include <thread>
+#include <sstream>
+#include <functional>
+
+#include <lmdbcols.hpp>
+
+using std::string;
+using std::vector;
+
+
+// ======================================================================
+// == Bailing out
+
+namespace {
+    const string fs_usage =
+        "USAGE: \n"
+        "  ./bench DB_NAME\n"
+        "\n"
+        "NB there must be no file present at DB_NAME.\n";
+
+    void bailWithMsgAndUsage( const string &msg ) {
+        std::cerr
+            << std::endl
+            << "========== BAILING: ==========" << std::endl
+            << "## " << msg << std::endl
+            << fs_usage << std::endl;
+        exit(1);
+    }
+}  // anon namespace
+
+
+// ======================================================================
+// == Results and timing
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    struct Result {
+        string name;
+        string params;   // e.g. "value_bytes=4096", or empty
+        size_t ops;
+        double seconds;
+        double p50ns, p99ns;  // Negative if ops weren't timed one by one
+    };
+
+    vector<Result> fs_results;
+
+    // Somewhere for benchmarks to put what they read, so it isn't optimised away
+    volatile double fs_sink = 0;
+
+    double secondsSince( Clock::time_point start ) {
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    }
+
+    double percentile( vector<double> &sorted, double frac ) {
+        if(sorted.empty()) return -1;
+        return sorted[std::min(sorted.size() - 1, static_cast<size_t>(frac * sorted.size()))];
+    }
+
+    void record( Result res ) {
+        LMDBCOLS_LOG(res.name, res.params, res.ops / res.seconds);
+        fs_results.push_back(res);
+    }
+
+    // Throughput plus p50/p99 from per-op latencies (in ns; gets sorted)
+    void recordLatencies( const string &name, const string &params,
+                          vector<double> &latencies, double seconds ) {
+        std::sort(latencies.begin(), latencies.end());
+        record(Result{ name, params, latencies.size(), seconds,
+                       percentile(latencies, 0.5), percentile(latencies, 0.99) });
+    }
+
+    // For things only measurable as a whole (batches, loads)
+    void recordThroughput( const string &name, const string &params, size_t ops, double seconds ) {
+        record(Result{ name, params, ops, seconds, -1, -1 });
+    }
+
+    // Runs opFn(i) for i in [0, ops), timing each call
+    template <typename Fn>
+    void timeOps( const string &name, const string &params, size_t ops, Fn opFn ) {
+        vector<double> latencies (ops);
+        const auto start = Clock::now();
+        for(size_t i = 0; i < ops; ++i) {
+            const auto opStart = Clock::now();
+            opFn(i);
+            latencies[i] = std::chrono::duration<double, std::nano>(Clock::now() - opStart).count();
+        }
+        recordLatencies(name, params, latencies, secondsSince(start));
+    }
+
+    string param( const string &name, size_t val ) {
+        std::ostringstream os;
+        os << name << "=" << val;
+        return os.str();
+    }
+
+    void printJson() {
+        printf("{\n  \"benchmarks\": [\n");
+        for(size_t i = 0; i < fs_results.size(); ++i) {
+            const Result &r = fs_results[i];
+            printf("    {\"name\": \"%s\", \"params\": \"%s\", \"ops\": %zu, \"seconds\": %.6f, "
+                   "\"ops_per_sec\": %.1f, ",
+                   r.name.c_str(), r.params.c_str(), r.ops, r.seconds, r.ops / r.seconds);
+            if(r.p50ns < 0) printf("\"p50_ns\": null, \"p99_ns\": null}");
+            else            printf("\"p50_ns\": %.1f, \"p99_ns\": %.1f}", r.p50ns, r.p99ns);
+            printf(i + 1 < fs_results.size() ? ",\n" : "\n");
+        }
+        printf("  ]\n}\n");
+    }
+
+    // Keys 0..n-1 in a fixed pseudo-random order
+    vector<uint64_t> shuffledKeys( size_t n ) {
+        auto res = vector<uint64_t>(n);
+        for(size_t i = 0; i < n; ++i) res[i] = i;
+        std::shuffle(res.begin(), res.end(), std::mt19937_64{42});
+        return res;
+    }
+}  // anon namespace
+
+
+// ======================================================================
+// == Benchmarks
+
+namespace {
+    using lmdbcols::DatabaseEnvironment;
+
+    const size_t fs_numKeys    = 100000;
+    const size_t fs_numLookups = 1000000;
+
+    using BenchDB = lmdbcols::MapDB_Pod_Pod<uint64_t, double>;
+
+    // Fixed size values for MapDB_Pod_Pod
+    template <size_t N>
+    struct Blob { uint64_t words[N / 8]; };
+
+    void fillBenchDb( DatabaseEnvironment &env ) {
+        auto db = BenchDB{env, "bench_dbi"};
+        auto txn = env.openWriteTxn();
+        for(uint64_t i = 0; i < fs_numKeys; ++i) db.put(txn, i, i * 0.5);
+        txn.commit();
+    }
+
+    // Name-only collections look the DB handle up in every call, env-constructed
+    // ones resolve it once up front
+    void benchDbiCaching( DatabaseEnvironment &env ) {
+        auto cachedDb = BenchDB{env, "bench_dbi"};
+        auto byNameDb = BenchDB{"bench_dbi"};
+        auto txn = env.openReadTxn();
+        timeOps("get, handle opened per call", "", fs_numLookups, [&](size_t i) {
+                fs_sink += byNameDb.get(txn, (i * 7919) % fs_numKeys); });
+        timeOps("get, handle cached", "", fs_numLookups, [&](size_t i) {
+                fs_sink += cachedDb.get(txn, (i * 7919) % fs_numKeys); });
+    }
+
+    // MapDB_Pod_Pod put/get, for one value size
+    template <size_t N>
+    void benchPodPodSize( DatabaseEnvironment &env ) {
+        using DB = lmdbcols::MapDB_Pod_Pod<uint64_t, Blob<N>>;
+        auto db = DB{env, param("bench_pod_pod", N)};
+        const size_t numKeys = std::max<size_t>(64, std::min<size_t>(fs_numKeys, (64UL << 20) / N));
+        const auto params = param("value_bytes", N);
+        Blob<N> val {};
+
+        {
+            auto txn = env.openWriteTxn();
+            timeOps("MapDB_Pod_Pod put, sequential keys", params, numKeys, [&](size_t i) {
+                    val.words[0] = i;
+                    db.put(txn, i, val); });
+            txn.commit();
+        }
+
+        const auto randomKeys = shuffledKeys(numKeys);
+        auto txn = env.openReadTxn();
+        timeOps("MapDB_Pod_Pod get, sequential keys", params, fs_numLookups, [&](size_t i) {
+                fs_sink += db.get(txn, i % numKeys).words[0]; });
+        timeOps("MapDB_Pod_Pod get, random keys", params, fs_numLookups, [&](size_t i) {
+                fs_sink += db.get(txn, randomKeys[i % numKeys]).words[0]; });
+    }
+
+    // MapDB_Pod_PodArray put/get, for one value size (reading every element)
+    void benchPodArraySize( DatabaseEnvironment &env, size_t valueBytes ) {
+        using DB = lmdbcols::MapDB_Pod_PodArray<uint64_t, double>;
+        auto db = DB{env, param("bench_pod_arr", valueBytes)};
+        const size_t numKeys = std::max<size_t>(64, std::min<size_t>(fs_numKeys, (64UL << 20) / valueBytes));
+        const size_t numGets = std::max<size_t>(1000, std::min<size_t>(fs_numLookups, (1UL << 30) / valueBytes));
+        const auto params = param("value_bytes", valueBytes);
+        const auto vals = vector<double>(valueBytes / sizeof(double), 1.0);
+
+        {
+            auto txn = env.openWriteTxn();
+            timeOps("MapDB_Pod_PodArray put, sequential keys", params, numKeys, [&](size_t i) {
+                    db.put(txn, i, &vals[0], vals.size()); });
+            txn.commit();
+        }
+        
+        auto sumOf = [](lmdbcols::LmdbSpan<double> sp) {
+            double res = 0;
+            for(double d : sp) res += d;
+            return res;
+        };
+        const auto randomKeys = shuffledKeys(numKeys);
+        auto txn = env.openReadTxn();
+        timeOps("MapDB_Pod_PodArray get, sequential keys", params, numGets, [&](size_t i) {
+                fs_sink += sumOf(db.get(txn, i % numKeys)); });
+        timeOps("MapDB_Pod_PodArray get, random keys", params, numGets, [&](size_t i) {
+                fs_sink += sumOf(db.get(txn, randomKeys[i % numKeys])); });
+    }
+
+    void benchPointOps( DatabaseEnvironment &env ) {
+        benchPodPodSize<8>(env);
+        benchPodPodSize<64>(env);
+        benchPodPodSize<512>(env);
+        benchPodPodSize<4096>(env);
+        for(size_t bytes = 8; bytes <= (1UL << 20); bytes *= 8)
+            benchPodArraySize(env, bytes);
+        benchPodArraySize(env, 1UL << 20);
+    }
+
+    // Arrays of chars: padded for you, padded by hand, or stored packed
+    void benchAutoPadding( DatabaseEnvironment &env ) {
+        const size_t numKeys = 10000, arrLen = 256;
+        const auto chars = vector<char>(arrLen, 'x');
+        const auto params = param("elems", arrLen);
+
+        auto autoDb = lmdbcols::MapDB_AutoPadded_Pod_PodArray<uint64_t, char>{env, "bench_autopad"};
+        {
+            auto txn = env.openWriteTxn();
+            timeOps("char array put, AutoPadded", params, numKeys, [&](size_t i) {
+                    autoDb.put(txn, i, chars); });
+            txn.commit();
+        }
+
+        using PadChar = lmdbcols::EightPadded<char>;
+        auto manualDb = lmdbcols::MapDB_Pod_PodArray<uint64_t, PadChar>{env, "bench_manualpad"};
+        {
+            auto padded = vector<PadChar>{};
+            auto txn = env.openWriteTxn();
+            timeOps("char array put, manually padded", params, numKeys, [&](size_t i) {
+                    padded.clear();
+                    for(char c : chars) padded.push_back(PadChar{c});
+                    manualDb.put(txn, i, &padded[0], padded.size()); });
+            txn.commit();
+        }
+
+        auto packedDb = lmdbcols::MapDB_Pod_PackedArray<uint64_t, char>{env, "bench_packed"};
+        {
+            auto txn = env.openWriteTxn();
+            timeOps("char array put, PackedArray", params, numKeys, [&](size_t i) {
+                    packedDb.put(txn, i, chars); });
+            txn.commit();
+        }
+
+        auto txn = env.openReadTxn();
+        timeOps("char array get, AutoPadded", params, numKeys, [&](size_t i) {
+                for(auto &pc : autoDb.get(txn, i)) fs_sink += *pc; });
+        timeOps("char array get, manually padded", params, numKeys, [&](size_t i) {
+                for(auto &pc : manualDb.get(txn, i)) fs_sink += *pc; });
+        timeOps("char array get, PackedArray", params, numKeys, [&](size_t i) {
+                int sum = 0;
+                for(char c : packedDb.get(txn, i)) sum += c;
+                fs_sink += sum; });
+
+        auto dense = vector<char>(arrLen);
+        timeOps("char array get, PaddedSpan copyOut", params, numKeys, [&](size_t i) {
+                autoDb.getView(txn, i).copyOut(&dense[0]);
+                int sum = 0;
+                for(char c : dense) sum += c;
+                fs_sink += sum; });
+    }
+
+    // Slowly changing position series, stored raw vs delta+varint compressed
+    void benchCompressedArray( DatabaseEnvironment &env ) {
+        struct Pos { double lat, lon; uint64_t time; };
+        const size_t numKeys = 2000, seriesLen = 4096;
+        const auto params = param("elems", seriesLen);
+
+        auto series = vector<Pos>(seriesLen);
+        std::mt19937_64 rng {7};
+        std::uniform_real_distribution<double> step {-1e-5, 1e-5};
+        for(size_t i = 1; i < seriesLen; ++i)
+            series[i] = Pos{ series[i-1].lat + step(rng), series[i-1].lon + step(rng), i * 5 };
+
+        auto rawDb  = lmdbcols::MapDB_Pod_PodArray<uint64_t, Pos>{env, "bench_series_raw"};
+        auto compDb = lmdbcols::MapDB_Pod_CompressedArray<uint64_t, Pos>{env, "bench_series_comp"};
+        {
+            auto txn = env.openWriteTxn();
+            timeOps("series put, PodArray", params, numKeys, [&](size_t i) {
+                    rawDb.put(txn, i, &series[0], series.size()); });
+            timeOps("series put, CompressedArray", params, numKeys, [&](size_t i) {
+                    compDb.put(txn, i, series); });
+            txn.commit();
+        }
+        LMDBCOLS_LOG("Compression ratio", compDb.stats().ratio());
+
+        auto txn = env.openReadTxn();
+        timeOps("series get, PodArray", params, numKeys, [&](size_t i) {
+                fs_sink += rawDb.get(txn, i)[seriesLen - 1].lat; });
+        timeOps("series get, CompressedArray", params, numKeys, [&](size_t i) {
+                fs_sink += compDb.get(txn, i)[seriesLen - 1].lat; });
+
+        // Hot keys: the same few series decoded (and reduced) over and over
+        const size_t hotKeys = 16, hotGets = 100000;
+        auto lastLat = [&](lmdb::txn &t, uint64_t key) {return compDb.get(t, key)[seriesLen - 1].lat;};
+        timeOps("hot series get, CompressedArray", params, hotGets, [&](size_t i) {
+                fs_sink += lastLat(txn, i % hotKeys); });
+        auto cache = lmdbcols::ReadThroughCache<uint64_t, double>{};
+        timeOps("hot series get, CompressedArray + ReadThroughCache", params, hotGets, [&](size_t i) {
+                fs_sink += *cache.get(txn, i % hotKeys, lastLat); });
+    }
+
+    // Growing one big array a batch at a time, then reading windows of it:
+    // a whole-value rewrite per append vs chunked storage
+    void benchChunkedArray( DatabaseEnvironment &env ) {
+        const size_t batch = 1024, numBatches = 256, window = 4096;
+        const auto params = param("batch", batch);
+        const auto vals = vector<double>(batch, 1.5);
+
+        auto flatDb    = lmdbcols::MapDB_Pod_PodArray<uint64_t, double>{env, "bench_grow_flat"};
+        auto chunkedDb = lmdbcols::MapDB_Pod_ChunkedArray<uint64_t, double>{env, "bench_grow_chunked"};
+        {
+            auto txn = env.openWriteTxn();
+            auto grown = vector<double>{};
+            timeOps("array append, PodArray rewrite", params, numBatches, [&](size_t) {
+                    grown.insert(grown.end(), vals.begin(), vals.end());
+                    flatDb.put(txn, 1, grown.data(), grown.size()); });
+            timeOps("array append, ChunkedArray", params, numBatches, [&](size_t) {
+                    chunkedDb.append(txn, 1, vals.data(), vals.size()); });
+            txn.commit();
+        }
+
+        auto txn = env.openReadTxn();
+        auto out = vector<double>{};
+        const size_t total = batch * numBatches;
+        timeOps("array window read, ChunkedArray", param("elems", window), 1000, [&](size_t i) {
+                chunkedDb.getRange(txn, 1, (i * 7919) % (total - window), window, out);
+                fs_sink += out.back(); });
+    }
+
+    // Summing one field of a wide record: row-wise vs column-wise storage
+    struct WideRec { uint64_t id; double price; double other[6]; };
+
+    void benchColumnScan( DatabaseEnvironment &env ) {
+        const size_t numRecs = 1000000;
+        const auto params = param("records", numRecs);
+
+        auto rowDb = lmdbcols::MapDB_Pod_Pod<uint64_t, WideRec>{env, "bench_rows"};
+        using ColDb = lmdbcols::ColumnarDB<uint64_t, WideRec, LMDBCOLS_FIELD(WideRec, price)>;
+        auto colDb = ColDb{env, "bench_cols"};
+        {
+            auto txn = env.openWriteTxn();
+            auto app = colDb.appender(txn);
+            for(uint64_t i = 0; i < numRecs; ++i) {
+                const auto rec = WideRec{ i, i * 0.25, {} };
+                rowDb.put(txn, i, rec);
+                app.add(i, rec);
+            }
+            app.finish();
+            txn.commit();
+        }
+
+        auto txn = env.openReadTxn();
+        {
+            const auto start = Clock::now();
+            double sum = 0;
+            for(auto kv : rowDb.scan(txn)) sum += kv.second.price;
+            fs_sink += sum;
+            recordThroughput("field sum scan, MapDB_Pod_Pod rows", params, numRecs, secondsSince(start));
+        }
+        {
+            const auto start = Clock::now();
+            double sum = 0;
+            for(auto blk : colDb.column<0>(txn))
+                for(double p : blk.second) sum += p;
+            fs_sink += sum;
+            recordThroughput("field sum scan, ColumnarDB column", params, numRecs, secondsSince(start));
+        }
+    }
+
+    // parallelReduce over a big DB, from 1 thread up to hardware_concurrency
+    void benchParallelScan( DatabaseEnvironment &env ) {
+        const size_t numEntries = 4000000;
+        auto db = lmdbcols::MapDB_Pod_Pod<uint64_t, double>{env, "bench_parallel"};
+        {
+            auto loader = db.bulkLoader(env);
+            for(uint64_t i = 0; i < numEntries; ++i) loader.add(i, i * 0.5);
+            loader.finish();
+        }
+
+        const size_t maxThreads = std::max(1u, std::thread::hardware_concurrency());
+        for(size_t numThreads = 1; ; numThreads = std::min(numThreads * 2, maxThreads)) {
+            auto opts = lmdbcols::ParallelScanOptions{};
+            opts.threads = numThreads;
+            lmdbcols::ParallelScanStats stats;
+            fs_sink += lmdbcols::parallelReduce(
+                env, db, 0.0,
+                [](double &acc, const uint64_t &, const double &v) {acc += v;},
+                [](double &acc, const double &o) {acc += o;},
+                opts, &stats);
+            recordThroughput("parallelReduce sum", param("threads", numThreads), numEntries, stats.seconds);
+            if(numThreads == maxThreads) break;
+        }
+    }
+
+    // Many threads each making small durable writes: one txn per write vs
+    // combined through a GroupCommitWriter
+    void benchGroupCommit( DatabaseEnvironment &env ) {
+        const size_t numThreads = 8, opsPerThread = 250;
+        const auto params = param("threads", numThreads);
+        auto db = BenchDB{env, "bench_group_commit"};
+
+        auto runThreads = [&](const string &name, std::function<void(uint64_t)> writeOne) {
+            auto perThread = vector<vector<double>>(numThreads, vector<double>(opsPerThread));
+            auto threads = vector<std::thread>{};
+            const auto start = Clock::now();
+            for(size_t t = 0; t < numThreads; ++t) {
+                threads.emplace_back([&, t] {
+                        for(size_t i = 0; i < opsPerThread; ++i) {
+                            const auto opStart = Clock::now();
+                            writeOne(t * opsPerThread + i);
+                            perThread[t][i] = std::chrono::duration<double, std::nano>(
+                                                  Clock::now() - opStart).count();
+                        } });
+            }
+            for(auto &th : threads) th.join();
+            const double secs = secondsSince(start);
+            auto all = vector<double>{};
+            for(auto &lats : perThread) all.insert(all.end(), lats.begin(), lats.end());
+            recordLatencies(name, params, all, secs);
+        };
+
+        runThreads("small durable writes, txn each", [&](uint64_t k) {
+                auto txn = env.openWriteTxn();
+                db.put(txn, k, 1.0);
+                txn.commit(); });
+
+        lmdbcols::GroupCommitWriter writer {env};
+        runThreads("small durable writes, GroupCommitWriter", [&](uint64_t k) {
+                writer.put(db, k, 2.0).get(); });
+        LMDBCOLS_LOG("Group commit avg batch", writer.stats().avgBatchOps());
+    }
+
+    // Small write txns and random gets under each durability mode, each in an
+    // env of its own next to the main bench DB
+    void benchDurabilityModes( const string &dbName ) {
+        using lmdbcols::EnvOptions;
+        struct Mode { string name; EnvOptions opts; };
+        auto base = EnvOptions{};
+        base.maxSize = 1UL << 30;
+        auto modes = vector<Mode>{};
+        modes.push_back(Mode{ "default", base });
+        { auto o = base; o.noMetaSync = true;                 modes.push_back(Mode{ "nometasync", o }); }
+        { auto o = base; o.noSync = true;                     modes.push_back(Mode{ "nosync", o }); }
+        { auto o = base; o.noSync = true; o.syncInterval = std::chrono::milliseconds{100};
+                                                              modes.push_back(Mode{ "nosync+sync100ms", o }); }
+        { auto o = base; o.writeMap = true;                   modes.push_back(Mode{ "writemap", o }); }
+        { auto o = base; o.writeMap = true; o.mapAsync = true; modes.push_back(Mode{ "writemap+mapasync", o }); }
+        { auto o = base; o.noReadahead = true;                modes.push_back(Mode{ "nordahead", o }); }
+        { auto o = base; o.noMemInit = true;                  modes.push_back(Mode{ "nomeminit", o }); }
+
+        const size_t numCommits = 2000;
+        for(auto &mode : modes) {
+            const auto params = "mode=" + mode.name;
+            auto env = DatabaseEnvironment{ dbName + "-mode-" + mode.name, mode.opts };
+            auto db = BenchDB{env, "bench_durability"};
+            timeOps("write txn commit, 1 put", params, numCommits, [&](size_t i) {
+                    auto txn = env.openWriteTxn();
+                    db.put(txn, i, 1.0);
+                    txn.commit(); });
+            env.sync();
+
+            const auto randomKeys = shuffledKeys(numCommits);
+            auto txn = env.openReadTxn();
+            timeOps("get, random keys", params, fs_numLookups / 10, [&](size_t i) {
+                    fs_sink += db.get(txn, randomKeys[i % numCommits]); });
+        }
+    }
+
+    // One lookup per read txn, as e.g. an RPC handler would do
+    void benchReadTxnOpen( DatabaseEnvironment &env ) {
+        auto db = BenchDB{env, "bench_dbi"};
+        const size_t numTxns = fs_numLookups / 4;
+
+        timeOps("read txn + get, open/abort", "", numTxns, [&](size_t i) {
+                auto txn = env.openReadTxn();
+                fs_sink += db.get(txn, i % fs_numKeys); });
+        timeOps("read txn + get, pooled reset/renew", "", numTxns, [&](size_t i) {
+                auto txn = env.acquireReadTxn();
+                fs_sink += db.get(txn, i % fs_numKeys); });
+    }
+
+    // Fan-out style lookups: batches of scattered keys
+    void benchGetMany( DatabaseEnvironment &env ) {
+        auto db = BenchDB{env, "bench_dbi"};
+        const size_t batchSize = 1000, numBatches = fs_numLookups / batchSize;
+        const auto params = param("batch", batchSize);
+        auto keys = vector<uint64_t>(batchSize);
+        auto fillKeys = [&](size_t b) {
+            for(size_t i = 0; i < batchSize; ++i) keys[i] = ((b * batchSize + i) * 7919) % fs_numKeys;
+        };
+
+        auto txn = env.openReadTxn();
+        timeOps("batched lookups, get() loop", params, numBatches, [&](size_t b) {
+                fillKeys(b);
+                for(auto k : keys) fs_sink += db.get(txn, k); });
+
+        vector<const double *> out;
+        vector<bool> found;
+        timeOps("batched lookups, getMany()", params, numBatches, [&](size_t b) {
+                fillKeys(b);
+                db.getMany(txn, keys, out, found);
+                for(auto p : out) fs_sink += *p; });
+    }
+
+    // Filling a DB from sorted keys, one put() at a time vs through BulkLoader
+    void benchBulkLoad( DatabaseEnvironment &env ) {
+        using ArrDB = lmdbcols::MapDB_Pod_PodArray<uint64_t, double>;
+        const auto vals = vector<double>(16, 1.5);
+        const auto params = param("value_bytes", vals.size() * sizeof(double));
+
+        auto putDb = ArrDB{env, "bench_bulk_put"};
+        {
+            const auto start = Clock::now();
+            auto txn = env.openWriteTxn();
+            for(uint64_t i = 0; i < fs_numKeys; ++i) putDb.put(txn, i, &vals[0], vals.size());
+            txn.commit();
+            recordThroughput("sorted load, put()", params, fs_numKeys, secondsSince(start));
+        }
+
+        auto bulkDb = ArrDB{env, "bench_bulk_append"};
+        {
+            auto loader = bulkDb.bulkLoader(env);
+            for(uint64_t i = 0; i < fs_numKeys; ++i) loader.add(i, &vals[0], vals.size());
+            const auto &stats = loader.finish();
+            recordThroughput("sorted load, BulkLoader", params, stats.records, stats.seconds);
+        }
+    }
+
+    // Background warm-up walk over a whole DB (already in the page cache
+    // here, so this is the walk's own cost, not disk speed)
+    void benchWarmUp( DatabaseEnvironment &env ) {
+        auto db = BenchDB{env, "bench_dbi"};
+        const auto progress = lmdbcols::warmUpDb(env, db)->wait();
+        recordThroughput("warm-up walk", param("bytes", progress.bytes), progress.records, progress.seconds);
+    }
+
+    // Expiring old data: key-by-key erase() vs one eraseRange() cursor walk
+    void benchErase( DatabaseEnvironment &env ) {
+        auto db = BenchDB{env, "bench_erase"};
+        const size_t half = fs_numKeys / 2;
+        {
+            auto txn = env.openWriteTxn();
+            for(uint64_t i = 0; i < fs_numKeys; ++i) db.put(txn, i, i * 0.5);
+            txn.commit();
+        }
+        auto txn = env.openWriteTxn();
+        {
+            const auto start = Clock::now();
+            for(uint64_t i = 0; i < half; ++i) db.erase(txn, i);
+            recordThroughput("expire, erase() per key", "", half, secondsSince(start));
+        }
+        {
+            const auto start = Clock::now();
+            const size_t erased = db.eraseRange(txn, half, fs_numKeys);
+            recordThroughput("expire, eraseRange()", "", erased, secondsSince(start));
+        }
+        txn.commit();
+    }
+
+    // Moving data out and back in: a collection through the flat format (ops
+    // are records), and the whole env via snapshotTo() (ops are MB copied)
+    void benchSnapshots( DatabaseEnvironment &env, const string &dbName ) {
+        auto srcDb = lmdbcols::MapDB_Pod_PodArray<uint64_t, double>{env, "bench_bulk_append"};
+        const string flatPath = dbName + "-flat";
+        {
+            std::ofstream out {flatPath, std::ios::binary};
+            auto txn = env.openReadTxn();
+            const auto stats = lmdbcols::dumpFlat(txn, srcDb, out);
+            recordThroughput("flat dump", param("bytes", stats.bytes), stats.records, stats.seconds);
+        }
+        {
+            std::ifstream in {flatPath, std::ios::binary};
+            auto dstDb = lmdbcols::MapDB_Pod_PodArray<uint64_t, double>{env, "bench_flat_load"};
+            const auto stats = lmdbcols::loadFlat(env, dstDb, in);
+            recordThroughput("flat load", param("bytes", stats.bytes), stats.records, stats.seconds);
+        }
+
+        for(bool compact : {false, true}) {
+            const auto stats = env.snapshotTo(dbName + (compact ? "-snap-compact" : "-snap-copy"), compact);
+            recordThroughput(compact ? "env snapshot, compacted" : "env snapshot, plain copy",
+                             param("bytes", stats.bytes), stats.bytes >> 20, stats.seconds);
+        }
+    }
+
+    // Random gets from 1..N threads at once, each with its own read txn
+    void benchReaderScaling( DatabaseEnvironment &env ) {
+        auto db = BenchDB{env, "bench_dbi"};
+        const size_t maxThreads = std::max(1u, std::thread::hardware_concurrency());
+        const size_t opsPerThread = fs_numLookups / 4;
+        const auto randomKeys = shuffledKeys(fs_numKeys);
+
+        for(size_t numThreads = 1; ; numThreads = std::min(numThreads * 2, maxThreads)) {
+            auto perThread = vector<vector<double>>(numThreads, vector<double>(opsPerThread));
+            auto sums = vector<double>(numThreads);  // Into fs_sink after join, not racing on it
+            auto threads = vector<std::thread>{};
+            const auto start = Clock::now();
+            for(size_t t = 0; t < numThreads; ++t) {
+                threads.emplace_back([&, t] {
+                        auto txn = env.openReadTxn();
+                        double sum = 0;
+                        for(size_t i = 0; i < opsPerThread; ++i) {
+                            const auto opStart = Clock::now();
+                            sum += db.get(txn, randomKeys[(i + t * 7919) % fs_numKeys]);
+                            perThread[t][i] = std::chrono::duration<double, std::nano>(
+                                                  Clock::now() - opStart).count();
+                        }
+                        sums[t] = sum; });
+            }
+            for(auto &th : threads) th.join();
+            const double secs = secondsSince(start);
+            for(double sum : sums) fs_sink += sum;
+
+            auto all = vector<double>{};
+            for(auto &lats : perThread) all.insert(all.end(), lats.begin(), lats.end());
+            recordLatencies("concurrent random get", param("threads", numThreads), all, secs);
+            if(numThreads == maxThreads) break;
+        }
+    }
+}  // anon namespace
+
+
+// ======================================================================
+// == main()
+
+int main( int argc, char *argv[] ) {
+    if(argc != 2) bailWithMsgAndUsage("Bad arg count");
+    const string dbName = argv[1];
+
+    {
+        std::ifstream testStreamDontUse {dbName.c_str()};
+        if(testStreamDontUse) bailWithMsgAndUsage("File exists at that DB name");
+    }
+
+    auto opts = lmdbcols::EnvOptions{};
+    opts.maxSize = 8UL << 30;  // Sparse; the biggest value sizes need room
+    opts.maxDbs  = 64;
+    auto env = DatabaseEnvironment{ dbName, opts };
+    fillBenchDb( env );
+
+    benchDbiCaching( env );
+    benchPointOps( env );
+    benchAutoPadding( env );
+    benchCompressedArray( env );
+    benchChunkedArray( env );
+    benchColumnScan( env );
+    benchReadTxnOpen( env );
+    benchGetMany( env );
+    benchBulkLoad( env );
+    benchSnapshots( env, dbName );
+    benchErase( env );
+    benchWarmUp( env );
+    benchReaderScaling( env );
+    benchParallelScan( env );
+    benchGroupCommit( env );
+    benchDurabilityModes( dbName );
+
+    printJson();
+    LMDBCOLS_LOG("All benchmarks finished");
+}